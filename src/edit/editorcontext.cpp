@@ -1,10 +1,13 @@
+#include <algorithm>
 #include <numeric>
+#include <optional>
 #include <cstring>
 #include <cstdio>
 
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "src/geometry.hpp"
+#include "src/timer.hpp"
 #include "src/gl/glcontext.hpp"
 #include "src/edit/editorcontext.hpp"
 #include "src/gl/texture.hpp"
@@ -53,21 +56,45 @@ bool l2d::editor::load(const char *path)
 		return false;
 	}
 
+	m_jnltextures = m_textures.size();
+	m_journal.open(m_path.c_str(), m_history, m_stamp);
+	m_jnlfrom = -1;
+	if(!replay()) {
+		// keep what replayed before the bad record, but the journal can't
+		// be appended to past it. start a new one holding the whole history.
+		m_journal.discard();
+		m_history = std::min<size_t>(m_history, m_indices.size());
+		m_jnlfrom = 0;
+	}
+
+	dirtyhistory(0);
 	resetpolys();
 
 	return true;
 }
 
 
+// snapshots the editor and writes the whole file on a worker thread. the
+// journal keeps the changes until the file is on disk.
 bool l2d::editor::save()
 {
 	if(m_path.empty()) {
 		return false;
 	}
 
-	l2d::file l2file;
-	l2file.load(*this);
-	l2file.save(m_path.c_str());
+	// one save at a time, the next snapshot waits for the last write
+	finishsave(true);
+	autosave(true);
+
+	m_stamp++;
+	l2d::file snapshot;
+	snapshot.load(*this);
+	m_journal.rebase(m_stamp);
+
+	std::string path = m_path;
+	m_saving = std::async(std::launch::async, [snapshot = std::move(snapshot), path]() {
+		return snapshot.save(path.c_str());
+	}).share();
 
 	return true;
 }
@@ -77,13 +104,249 @@ bool l2d::editor::save(const char *path)
 {
 	//wxASSERT(filename.GetExt() == "l2d");
 
+	finishsave(true);
+
+	// a journal already next to a different file isn't ours
+	if(m_path != path) {
+		m_journal.create(path, m_history, m_stamp);
+	} else {
+		m_journal.open(path, m_history, m_stamp);
+	}
 	m_name = path;
 	m_path = path;
+	m_jnltextures = m_textures.size();
+	m_jnlfrom = -1;
 
 	return save();
 }
 
 
+// picks up the result of the background save
+void l2d::editor::finishsave(bool wait)
+{
+	if(!m_saving.valid()) {
+		return;
+	}
+
+	if(!wait && m_saving.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+		return;
+	}
+
+	if(m_saving.get()) {
+		m_journal.saved(m_stamp);
+	}
+
+	m_saving = {};
+}
+
+
+// appends what changed since the last call to the journal
+void l2d::editor::autosave(bool force)
+{
+	if(m_path.empty()) {
+		return;
+	}
+
+	finishsave(false);
+
+	for(; m_jnltextures < m_textures.size(); m_jnltextures++) {
+		std::vector<unsigned char> data, strings;
+		l2d::texinfo info = {};
+		m_textures[m_jnltextures].serialize(info, data, strings);
+
+		std::vector<uint8_t> buf(sizeof(info) + strings.size() + data.size());
+		memcpy(buf.data(), &info, sizeof(info));
+		memcpy(buf.data() + sizeof(info), strings.data(), strings.size());
+		memcpy(buf.data() + sizeof(info) + strings.size(), data.data(), data.size());
+		m_journal.append(l2d::journal::TEXTURE, m_jnltextures, buf.data(), buf.size());
+	}
+
+	if(m_jnlfrom < m_indices.size()) {
+		for(size_t i = m_jnlfrom; i < m_indices.size(); i++) {
+			uint8_t buf[sizeof(act::index) + sizeof(act::scale)];
+			size_t size = getpayload(m_indices[i], buf + sizeof(act::index));
+			memcpy(buf, &m_indices[i], sizeof(act::index));
+			m_journal.append(l2d::journal::SET, i, buf, sizeof(act::index) + size);
+		}
+	} else if(m_jnlfrom != -1) {
+		// indices were only dropped
+		m_journal.append(l2d::journal::TRUNCATE, m_indices.size(), nullptr, 0);
+	}
+
+	m_jnlfrom = -1;
+	m_journal.history(m_history);
+	m_journal.flush(force);
+}
+
+
+bool l2d::editor::autosavepending() const
+{
+	return m_journal.pending() || m_saving.valid();
+}
+
+
+// applies the journal left over from the last session, false if it holds
+// a record that can't be applied
+bool l2d::editor::replay()
+{
+	std::vector<uint8_t> data;
+	if(!m_journal.read(data)) {
+		// no journal, nothing unsaved
+		return true;
+	}
+
+	l2d::journal::record rec;
+	const uint8_t *payload;
+	bool based = false;
+
+	for(size_t ofs = 0; (ofs = l2d::journal::next(data, ofs, rec, payload)) != 0;) {
+		// skip what the file already holds
+		if(!based) {
+			based = rec.kind == l2d::journal::BASE && rec.position == m_stamp;
+			continue;
+		}
+
+		switch(rec.kind) {
+		case l2d::journal::SET: {
+			if(rec.size < sizeof(act::index) || rec.position > m_indices.size()) {
+				return false;
+			}
+
+			while(m_indices.size() > rec.position) {
+				popindex();
+			}
+
+			act::index act;
+			memcpy(&act, payload, sizeof(act::index));
+			if(!setpayload(act, payload + sizeof(act::index), rec.size - sizeof(act::index))) {
+				return false;
+			}
+			m_indices.push_back(act);
+			break;
+		}
+		case l2d::journal::TRUNCATE:
+			while(m_indices.size() > rec.position) {
+				popindex();
+			}
+			break;
+		case l2d::journal::HISTORY:
+			m_history = rec.position;
+			break;
+		case l2d::journal::TEXTURE: {
+			l2d::texinfo info;
+			if(rec.size < sizeof(info)) {
+				return false;
+			}
+
+			memcpy(&info, payload, sizeof(info));
+			if(sizeof(info) + info.name_size + info.size() != rec.size) {
+				return false;
+			}
+
+			// a journal already folded into the file is harmless
+			if(rec.position != m_textures.size()) {
+				break;
+			}
+
+			const uint8_t *name = payload + sizeof(info);
+			uint8_t *texels = new uint8_t[info.size()];
+			memcpy(texels, name + info.name_size, info.size());
+
+			std::string str(name, name + info.name_size);
+			gl::texture &texture = m_textures.emplace_back();
+			texture.load(info.width, info.height, info.pixelwidth, str.c_str(), gl::texture::pixels(texels));
+			break;
+		}
+		case l2d::journal::BASE:
+			break;
+		default:
+			return false;
+		}
+
+		m_history = std::min<size_t>(m_history, m_indices.size());
+	}
+
+	m_jnltextures = m_textures.size();
+	return true;
+}
+
+
+template<typename T>
+static size_t copypayload(const std::vector<T> &v, uint32_t i, uint8_t out[])
+{
+	if(i >= v.size()) {
+		return 0;
+	}
+
+	memcpy(out, &v[i], sizeof(T));
+	return sizeof(T);
+}
+
+
+template<typename T>
+static bool pushpayload(std::vector<T> &v, uint32_t &i, const uint8_t payload[], size_t size)
+{
+	if(size != sizeof(T)) {
+		return false;
+	}
+
+	i = v.size();
+	memcpy(&v.emplace_back(), payload, sizeof(T));
+	return true;
+}
+
+
+// index the next payload of type is pushed to
+uint32_t l2d::editor::payloadslot(act::type type) const
+{
+	switch(type) {
+	case act::type::LINE: return m_lines.size();
+	case act::type::RECT: return m_rects.size();
+	case act::type::MOVE: return m_moves.size();
+	case act::type::SCALE: return m_scales.size();
+	case act::type::TEXTURE: return m_acttextures.size();
+	case act::type::LAYER: return m_actlayers.size();
+	case act::type::DEL: return -1;
+	}
+
+	return -1;
+}
+
+
+// copies the payload of an index to out, returns its size
+size_t l2d::editor::getpayload(const act::index &act, uint8_t out[]) const
+{
+	switch(act.type) {
+	case act::type::LINE: return copypayload(m_lines, act.index, out);
+	case act::type::RECT: return copypayload(m_rects, act.index, out);
+	case act::type::MOVE: return copypayload(m_moves, act.index, out);
+	case act::type::SCALE: return copypayload(m_scales, act.index, out);
+	case act::type::TEXTURE: return copypayload(m_acttextures, act.index, out);
+	case act::type::LAYER: return copypayload(m_actlayers, act.index, out);
+	case act::type::DEL: return 0;
+	}
+
+	return 0;
+}
+
+
+// appends a payload read back for an index and points the index at it
+bool l2d::editor::setpayload(act::index &act, const uint8_t payload[], size_t size)
+{
+	switch(act.type) {
+	case act::type::LINE: return pushpayload(m_lines, act.index, payload, size);
+	case act::type::RECT: return pushpayload(m_rects, act.index, payload, size);
+	case act::type::MOVE: return pushpayload(m_moves, act.index, payload, size);
+	case act::type::SCALE: return pushpayload(m_scales, act.index, payload, size);
+	case act::type::TEXTURE: return pushpayload(m_acttextures, act.index, payload, size);
+	case act::type::LAYER: return pushpayload(m_actlayers, act.index, payload, size);
+	case act::type::DEL: return size == 0;
+	}
+
+	return false;
+}
+
+
 l2d::editor::editor(int width, int height)
 	: m_name("untitled"),
 	  m_width(width),
@@ -126,6 +389,8 @@ void l2d::editor::setupview()
 	m_view = glm::identity<glm::mat4>();
 	m_view = glm::scale(m_view, zoom);
 	m_view = glm::translate(m_view, pan);
+
+	invalidate(REDRAW_VIEW);
 }
 
 
@@ -171,6 +436,73 @@ glm::vec2 l2d::editor::screentoworld(glm::vec2 screen) const
 }
 
 
+// visible world rectangle, padded so outlines and points
+// of polys just off screen still get drawn
+irect2d l2d::editor::viewrect() const
+{
+	static constexpr float PAD_PIXELS = 8.0f;
+
+	glm::vec2 a = screentoworld(glm::vec2(0.0f, 0.0f));
+	glm::vec2 b = screentoworld(glm::vec2(m_width, m_height));
+	glm::vec2 mins = glm::min(a, b);
+	glm::vec2 maxs = glm::max(a, b);
+
+	/* the selected poly's planes stick out by one unit */
+	float pad = PAD_PIXELS / m_zoom + 1.0f;
+
+	irect2d r;
+	r.mins = glm::i32vec2(glm::floor(mins - pad));
+	r.maxs = glm::i32vec2(glm::ceil(maxs + pad));
+	return r;
+}
+
+
+void l2d::editor::querypolys(const layer &layer, const irect2d &r, std::vector<size_t> &out) const
+{
+	out.clear();
+	layer.grid.query(r, [&](size_t i) {
+		out.push_back(i);
+		return false;
+	});
+
+	// keep the order polys were added in
+	std::sort(out.begin(), out.end());
+}
+
+
+// the most recently added poly of the layer containing pt
+size_t l2d::editor::polyat(const layer &layer, const glm::vec2 &pt) const
+{
+	size_t found = -1;
+	glm::i32vec2 p = glm::floor(pt);
+
+	layer.grid.query(irect2d(p, p + 1), [&](size_t i) {
+		if(m_polys[i].contains(pt) && (found == -1 || i > found)) {
+			found = i;
+		}
+		return false;
+	});
+
+	return found;
+}
+
+
+bool l2d::editor::overlaps(const layer &layer, const irect2d &r) const
+{
+	return layer.grid.query(r, [&](size_t i) {
+		return m_polys[i].intersects(r);
+	});
+}
+
+
+bool l2d::editor::overlaps(const layer &layer, const poly2d &poly, size_t ignore) const
+{
+	return layer.grid.query(poly.aabb(), [&](size_t i) {
+		return i != ignore && poly.intersects(m_polys[i]);
+	});
+}
+
+
 void l2d::editor::drawpoly(const poly2d *p)
 {
 	bool is_selected = false;
@@ -238,7 +570,7 @@ void l2d::editor::drawpoly(const poly2d *p)
 		}
 	}
 
-	const std::vector<glm::vec2> &pts = p->points();
+	const poly2d::pointlist &pts = p->points();
 
 	outlinepoly(pts.data(), pts.size(), 3.0, BLACK);
 
@@ -270,20 +602,7 @@ void l2d::editor::drawpoly(const poly2d *p)
 			oc = m_outcode;
 			color = RED;
 		} else {
-			glm::vec2 wpos = m_wpos;
-			oc = aabb.outcode(wpos);
-
-			glm::vec2 mins = worldtoscreen(aabb.mins);
-			glm::vec2 maxs = worldtoscreen(aabb.maxs);
-			glm::vec2 mpos = worldtoscreen(wpos);
-
-			mins -= SELECTION_THRESHOLD;
-			maxs += SELECTION_THRESHOLD;
-
-			if(mpos.x > maxs.x || mpos.y > maxs.y ||
-			   mpos.x < mins.x || mpos.y < mins.y) {
-				highlight = false;
-			}
+			highlight = handlehover(aabb, oc);
 		}
 
 		int out_x = oc & irect2d::OUTX;
@@ -323,8 +642,238 @@ void l2d::editor::drawpoly(const poly2d *p)
 }
 
 
+bool l2d::editor::handlehover(const irect2d &aabb, int &oc) const
+{
+	glm::vec2 wpos = m_wpos;
+	oc = aabb.outcode(wpos);
+
+	glm::vec2 mins = worldtoscreen(aabb.mins);
+	glm::vec2 maxs = worldtoscreen(aabb.maxs);
+	glm::vec2 mpos = worldtoscreen(wpos);
+
+	mins -= SELECTION_THRESHOLD;
+	maxs += SELECTION_THRESHOLD;
+
+	if(mpos.x > maxs.x || mpos.y > maxs.y ||
+	   mpos.x < mins.x || mpos.y < mins.y) {
+		return false;
+	}
+
+	return true;
+}
+
+
+l2d::editor::hover l2d::editor::gethover() const
+{
+	hover h = {};
+	h.tool = ui_toolat(m_mpos);
+
+	switch(m_state & state::TOOL_MASK) {
+	case state::SELECT:
+		if(m_selectedpoly != -1 && !(m_state & state::IN_EDIT)) {
+			h.highlight = handlehover(m_polys[m_selectedpoly].aabb(), h.outcode);
+		}
+		break;
+	case state::RECT:
+	case state::LINE:
+		// both draw a point under the cursor
+		if(m_state != state::LINE_SLICE) {
+			h.gpos = s_gl->snaptogrid(m_wpos);
+		}
+		break;
+	default:
+		break;
+	}
+
+	return h;
+}
+
+
+bool l2d::editor::needspaint()
+{
+	hover h = gethover();
+	if(!(h == m_hover)) {
+		m_hover = h;
+		invalidate(REDRAW_HOVER);
+	}
+
+	return m_redraw != 0;
+}
+
+
+// the part of delta poly can be moved by without running into the rest of
+// the layer. x is resolved before y so a blocked poly slides along walls.
+glm::i32vec2 l2d::editor::sweepmove(const layer &layer, size_t poly, const glm::i32vec2 &delta)
+{
+	const poly2d &moving = m_polys[poly];
+	glm::i32vec2 moved = { 0, 0 };
+	m_sephints.resize(m_polys.size());
+
+	for(int axis = 0; axis < 2; axis++) {
+		glm::i32vec2 d = { 0, 0 };
+		d[axis] = delta[axis];
+		if(d[axis] == 0) {
+			continue;
+		}
+
+		irect2d from = moving.aabb();
+		from.mins += moved;
+		from.maxs += moved;
+		irect2d swept = from;
+		swept.mins = glm::min(from.mins, from.mins + d);
+		swept.maxs = glm::max(from.maxs, from.maxs + d);
+
+		// each neighbour can only cut the move shorter
+		int steps = d[axis];
+		layer.grid.query(swept, [&](size_t i) {
+			if(i != poly) {
+				steps = moving.sweep(m_polys[i], moved, axis, steps, m_sephints[i]);
+			}
+			return steps == 0;
+		});
+
+		moved[axis] = steps;
+	}
+
+	return moved;
+}
+
+
+// overlaps() for the poly being dragged, starting each neighbour from the
+// axis that separated them on the previous motion event
+bool l2d::editor::collides(const layer &layer, size_t poly)
+{
+	const poly2d &moving = m_polys[poly];
+	m_sephints.resize(m_polys.size());
+
+	return layer.grid.query(moving.aabb(), [&](size_t i) {
+		return i != poly && moving.intersects(m_polys[i], m_sephints[i]);
+	});
+}
+
+
+// whole extents from m_start each dragged side of poly can take before
+// it runs into the rest of the layer. every motion event of the drag is
+// clamped to these instead of testing and undoing each step.
+void l2d::editor::scalerange(const layer &layer, size_t poly)
+{
+	// as far as the view can be panned and then some
+	static constexpr int REACH = static_cast<int>(MAX_PAN.x) * 2;
+
+	const poly2d &scaled = m_polys[poly];
+	glm::i32vec2 base = { 1, 1 };
+	irect2d reach = scaled.aabb();
+
+	for(int axis = 0; axis < 2; axis++) {
+		m_scalemin[axis] = 1;
+		m_scalemax[axis] = 1;
+
+		if(m_delta[axis] == 0) {
+			continue;
+		}
+		base[axis] = std::abs(m_delta[axis]);
+
+		// everything the dragged side could sweep over
+		irect2d sides = scaled.aabb();
+		if(m_delta[axis] < 0) {
+			sides.mins[axis] = m_start[axis] - REACH;
+		} else {
+			sides.maxs[axis] = m_start[axis] + REACH;
+		}
+		reach.mins = glm::min(reach.mins, sides.mins);
+		reach.maxs = glm::max(reach.maxs, sides.maxs);
+
+		int lo = 0;
+		int hi = REACH;
+		layer.grid.query(sides, [&](size_t i) {
+			if(i != poly) {
+				int l, h;
+				scaled.scalerange(m_polys[i], m_start, axis, base[axis], l, h);
+				lo = std::max(lo, l);
+				hi = std::min(hi, h);
+			}
+			return false;
+		});
+
+		m_scalemin[axis] = std::max(1, lo);
+		m_scalemax[axis] = std::max(m_scalemin[axis], hi);
+	}
+
+	if(m_delta.x == 0 || m_delta.y == 0) {
+		return;
+	}
+
+	// each range above holds the other side still. a corner drag moves
+	// both, so shrink the box of extents towards the start until it is
+	// proven clear of every neighbour as a whole.
+	std::vector<size_t> near;
+	layer.grid.query(reach, [&](size_t i) {
+		if(i != poly) {
+			near.push_back(i);
+		}
+		return false;
+	});
+
+	glm::i32vec2 mins = m_scalemin;
+	glm::i32vec2 maxs = m_scalemax;
+	auto clear = [&](const glm::i32vec2 &lo, const glm::i32vec2 &hi) {
+		for(size_t i : near) {
+			if(!scaled.scaleclear(m_polys[i], m_start, base, lo, hi)) {
+				return false;
+			}
+		}
+		return true;
+	};
+
+	if(clear(mins, maxs)) {
+		return;
+	}
+
+	// the box at t = 0 is the poly as it is, which is clear
+	float good = 0.0f;
+	float bad = 1.0f;
+	for(int i = 0; i < 16; i++) {
+		float t = (good + bad) * 0.5f;
+		glm::i32vec2 lo, hi;
+		for(int axis = 0; axis < 2; axis++) {
+			lo[axis] = base[axis] - static_cast<int>(t * (base[axis] - mins[axis]));
+			hi[axis] = base[axis] + static_cast<int>(t * (maxs[axis] - base[axis]));
+		}
+
+		if(clear(lo, hi)) {
+			good = t;
+			m_scalemin = lo;
+			m_scalemax = hi;
+		} else {
+			bad = t;
+		}
+	}
+
+	if(good == 0.0f) {
+		m_scalemin = base;
+		m_scalemax = base;
+	}
+}
+
+
+void l2d::editor::dirtypoly(size_t i)
+{
+	if(i < m_meshes.size()) {
+		m_meshes[i].dirty = true;
+	}
+
+	if(i < m_polys.size()) {
+		for(layer &layer : m_layers) {
+			layer.grid.update(i, m_polys[i].aabb());
+		}
+	}
+}
+
+
 void l2d::editor::mmotion(double x, double y)
 {
+	scopedtimer timer(m_motion_ms);
+
 	m_mpos = { x, y };
 	m_wpos = screentoworld(m_mpos);
 
@@ -379,66 +928,60 @@ void l2d::editor::mmotion(double x, double y)
 
 		if(m_outcode == irect2d::INSIDE) {
 			poly2d &selected = m_polys[m_selectedpoly];
-			m_start = gpos;
-
-			selected.offset(delta);
 
-			bool intersects = false;
-			for(size_t i : m_layers[m_selectedlayer].polys) {
-				const poly2d &poly = m_polys[i];
-				if(i != m_selectedpoly && selected.intersects(poly)) {
-					intersects = true;
-					break;
-				}
+			// slide as far as the neighbours allow, the rest of the
+			// drag stays pending until the cursor makes room
+			delta = sweepmove(m_layers[m_selectedlayer], m_selectedpoly, delta);
+			if(delta.x == 0 && delta.y == 0) {
+				return;
 			}
-
-			if(!intersects) {
-				// history should never be an invalid value here as we
-				// need to at least create a polygon before we move it.
-				act::index &back = m_indices[m_history - 1];
-
-				if(back.type == act::type::MOVE && back.poly == m_selectedpoly && back.layer == m_selectedlayer) {
-					/* we don't want to spam a move action for each pixel moved */
-					m_moves[back.index] += delta;
-				} else {
-					addindex(act::type::MOVE, m_selectedpoly, m_selectedlayer, m_moves.size());
-					m_moves.push_back(delta);
-				}
-				save();
+			m_start += delta;
+
+			// history should never be an invalid value here as we
+			// need to at least create a polygon before we move it.
+			act::index &back = m_indices[m_history - 1];
+
+			// record before moving, a new index may checkpoint the
+			// polys as they were before it
+			if(back.type == act::type::MOVE && back.poly == m_selectedpoly && back.layer == m_selectedlayer) {
+				/* we don't want to spam a move action for each pixel moved */
+				m_moves[back.index] += delta;
+				dirtyhistory(m_history - 1);
 			} else {
-				// go back
-				selected.offset(-delta);
-			}
-		} else {
-			poly2d &selected = m_polys[m_selectedpoly];
-			irect2d aabb = selected.aabb();
-			int outcode = aabb.outcode(m_wpos);
-
-			if(((outcode ^ m_outcode) & irect2d::OUTX) == irect2d::OUTX) {
-				m_delta.x = delta.x = 1;
+				addindex(act::type::MOVE, m_selectedpoly, m_selectedlayer);
+				m_moves.push_back(delta);
 			}
 
-			if(((outcode ^ m_outcode) & irect2d::OUTY) == irect2d::OUTY) {
-				m_delta.y = delta.y = 1;
-			}
+			selected.offset(delta);
+			dirtypoly(m_selectedpoly);
 
-			bool out_x = m_outcode & irect2d::OUTX;
-			bool out_y = m_outcode & irect2d::OUTY;
-			if(out_x && !out_y) m_delta.y = delta.y = 1;
-			if(out_y && !out_x) m_delta.x = delta.x = 1;
+			// the sweep only stops on steps it found clear
+			assert(!collides(m_layers[m_selectedlayer], m_selectedpoly));
+			invalidate(REDRAW_GEOMETRY | REDRAW_HISTORY);
+		} else {
+			poly2d &selected = m_polys[m_selectedpoly];
 
-			if(m_delta.x == 0 || m_delta.y == 0) {
-				m_state &= ~state::IN_EDIT;
-				return;
+			// m_delta holds the signed extent of each dragged side from
+			// the fixed corner, 0 for sides that aren't dragged. dragged
+			// sides follow the cursor within the room worked out when the
+			// drag started and can't cross over the fixed side.
+			glm::i32vec2 extent = m_delta;
+			glm::i32vec2 numer = { 1, 1 };
+			glm::i32vec2 denom = { 1, 1 };
+			for(int axis = 0; axis < 2; axis++) {
+				if(m_delta[axis] == 0) {
+					continue;
+				}
+				int sign = m_delta[axis] < 0 ? -1 : 1;
+				numer[axis] = std::clamp(delta[axis] * sign, m_scalemin[axis], m_scalemax[axis]);
+				denom[axis] = std::abs(m_delta[axis]);
+				extent[axis] = numer[axis] * sign;
 			}
 
-			if(delta.x == 0 || delta.y == 0 || delta == m_delta) {
+			if(numer == denom) {
 				return;
 			}
 
-			glm::i32vec2 numer = glm::abs(delta);
-			glm::i32vec2 denom = glm::abs(m_delta);
-
 			// normalize fraction
 			glm::i32vec2 g;
 			g.x = std::gcd(numer.x, denom.x);
@@ -446,67 +989,51 @@ void l2d::editor::mmotion(double x, double y)
 			numer /= g;
 			denom /= g;
 
-			// make sure scaling will result in a whole number.
-			glm::i32vec2 maxs = ((aabb.maxs - m_start) * numer);
-			glm::i32vec2 mins = ((aabb.mins - m_start) * numer);
-			if(maxs.x % denom.x != 0 || maxs.y % denom.y != 0) {
-				return;
-			}
-			if(mins.x % denom.x != 0 || mins.y % denom.y != 0) {
-				return;
-			}
-
-			selected.scale(m_start, numer, denom);
-
-			bool intersects = false;
-			for(size_t i : m_layers[m_selectedlayer].polys) {
-				const poly2d &poly = m_polys[i];
-				if(i != m_selectedpoly && selected.intersects(poly)) {
-					intersects = true;
-					break;
-				}
-			}
-
-			if(!intersects && denom != numer) {
-				m_delta = delta;
-				if(m_history != 0 && m_indices.size() != 0) {
-					act::index &back = m_indices[m_history - 1];
-					if(back.type == act::type::SCALE && back.poly == m_selectedpoly && back.layer == m_selectedlayer) {
-						act::scale &back_scale = m_scales[back.index];
-						if(m_start == back_scale.origin) {
-
-							back_scale.denom *= denom;
-							back_scale.numer *= numer;
-
-							glm::i32vec2 g;
-							g.x = std::gcd(back_scale.numer.x, back_scale.denom.x);
-							g.y = std::gcd(back_scale.numer.y, back_scale.denom.y);
-							back_scale.numer /= g;
-							back_scale.denom /= g;
-
-							/* remove if no-op */
-							if(back_scale.numer == back_scale.denom) {
-								m_history--;
-								m_indices.pop_back();
-							}
-							save();
-							return;
+			// record before scaling, like moves
+			bool merged = false;
+			if(m_history != 0 && m_indices.size() != 0) {
+				act::index &back = m_indices[m_history - 1];
+				if(back.type == act::type::SCALE && back.poly == m_selectedpoly && back.layer == m_selectedlayer) {
+					act::scale &back_scale = m_scales[back.index];
+					if(m_start == back_scale.origin) {
+
+						back_scale.denom *= denom;
+						back_scale.numer *= numer;
+
+						glm::i32vec2 g;
+						g.x = std::gcd(back_scale.numer.x, back_scale.denom.x);
+						g.y = std::gcd(back_scale.numer.y, back_scale.denom.y);
+						back_scale.numer /= g;
+						back_scale.denom /= g;
+						dirtyhistory(m_history - 1);
+
+						/* remove if no-op */
+						if(back_scale.numer == back_scale.denom) {
+							m_history--;
+							popindex();
 						}
+						merged = true;
 					}
 				}
+			}
 
-				act::index &back = addindex(act::type::SCALE, m_selectedpoly, m_selectedlayer, m_scales.size());
+			if(!merged) {
+				addindex(act::type::SCALE, m_selectedpoly, m_selectedlayer);
 
 				act::scale scale;
 				scale.origin = m_start;
 				scale.denom = denom;
 				scale.numer = numer;
 				m_scales.push_back(scale);
-				save();
-			} else {
-				// go back
-				selected.scale(m_start, denom, numer);
 			}
+
+			selected.scale(m_start, numer, denom);
+			dirtypoly(m_selectedpoly);
+			m_delta = extent;
+
+			// the range was proven clear when the drag started
+			assert(!collides(m_layers[m_selectedlayer], m_selectedpoly));
+			invalidate(REDRAW_GEOMETRY | REDRAW_HISTORY);
 		}
 		break;
 	default:
@@ -516,6 +1043,10 @@ void l2d::editor::mmotion(double x, double y)
 
 void l2d::editor::mwheel(double xoffs, double yoffs)
 {
+	if(ui_mwheel(yoffs)) {
+		return;
+	}
+
 	if(yoffs == 0) {
 		/* no scroll */
 	} else if(yoffs > 0) { /* scroll up */
@@ -543,26 +1074,56 @@ void l2d::editor::paint()
 {
 	const glm::vec4 bg = glm::vec4(0.9f, 0.9f, 0.9f, 1.0f);
 
+	m_redraw = 0;
+
+	// the overlay shows the frames before this one, this one is still running
+	m_frame_ms[m_framesample++ % FRAME_SAMPLES] = m_paint_ms;
+	m_framemotion_ms = m_motion_ms;
+	m_paint_ms = 0.0f;
+	m_motion_ms = 0.0f;
+	scopedtimer timer(m_paint_ms);
+
+	s_gl->beginframe();
 	s_gl->clear(bg);
 	s_gl->setmatrices(m_proj, m_view);
 	s_gl->drawgrid();
+	s_gl->begin();
+
+	if(m_meshes.size() < m_polys.size()) {
+		m_meshes.resize(m_polys.size());
+	}
+
+	irect2d view = viewrect();
 
 	for(layer &layer : m_layers) {
-		for(size_t i : layer.polys) {
-			if(i != m_selectedpoly) {
+		querypolys(layer, view, m_visible);
+		for(size_t i : m_visible) {
+			if(i == m_selectedpoly) {
+				continue;
+			}
+
+			gl::mesh &mesh = m_meshes[i];
+			if(mesh.dirty) {
+				s_gl->beginmesh(mesh);
 				drawpoly(&m_polys[i]);
+				s_gl->endmesh();
 			}
+
+			s_gl->drawmesh(mesh);
 		}
 	}
 
 	poly2d *poly = nullptr;
 	if(m_selectedpoly != -1) {
 		poly = &m_polys[m_selectedpoly];
-		if(m_state != state::LINE_SLICE) {
+		if(m_state != state::LINE_SLICE && poly->aabb().intersects(view)) {
 			drawpoly(poly);
 		}
 	}
 
+	// the edit overlays go over the level, outlines included
+	s_gl->flush();
+
 	glm::vec4 color = WHITE;
 	glm::vec2 mpos = s_gl->snaptogrid(m_wpos);
 
@@ -574,11 +1135,8 @@ void l2d::editor::paint()
 
 		irect2d r = irect2d(m_start, m_end);
 
-		for(size_t i : m_layers[m_selectedlayer].polys) {
-			poly2d &poly = m_polys[i];
-			if(poly.intersects(r)) {
-				color = RED;
-			}
+		if(overlaps(m_layers[m_selectedlayer], r)) {
+			color = RED;
 		}
 		// actually draw the rectangle
 		outlinerect(r, 3.0, BLACK);
@@ -594,12 +1152,8 @@ void l2d::editor::paint()
 		if(m_selectedlayer == -1) {
 			break;
 		}
-		for(size_t i : m_layers[m_selectedlayer].polys) {
-			poly2d &poly = m_polys[i];
-			if(poly.contains(m_start)) {
-				color = RED;
-				break;
-			}
+		if(polyat(m_layers[m_selectedlayer], m_start) != -1) {
+			color = RED;
 		}
 		drawpoint(m_start, color);
 		break;
@@ -637,6 +1191,8 @@ void l2d::editor::paint()
 		break;
 	}
 
+	s_gl->end();
+
 	ui_draw();
 }
 
@@ -648,6 +1204,8 @@ void l2d::editor::resize(int w, int h)
 	m_width = w;
 	m_height = h;
 
+	invalidate(REDRAW_ALL);
+
 	float width = static_cast<float>(w);
 	float height = static_cast<float>(h);
 	setupproj(width, height);
@@ -661,7 +1219,6 @@ void l2d::editor::outlinerect(const irect2d &rect, float thickness, const glm::v
 	glm::vec2 lb = { rect.mins.x, rect.maxs.y };
 	glm::vec2 rt = { rect.maxs.x, rect.mins.y };
 
-	thickness /= m_zoom;
 	s_gl->line(lt, rt, thickness, color);
 	s_gl->line(rt, rb, thickness, color);
 	s_gl->line(rb, lb, thickness, color);
@@ -670,7 +1227,6 @@ void l2d::editor::outlinerect(const irect2d &rect, float thickness, const glm::v
 
 void l2d::editor::drawline(const glm::vec2 &a, const glm::vec2 &b, float thickness, const glm::vec4 &color)
 {
-	thickness /= m_zoom;
 	s_gl->line(a, b, thickness, color);
 }
 
@@ -680,50 +1236,346 @@ void l2d::editor::texturepoly(const glm::vec2 pts[], size_t npts, const irect2d
 }
 
 
-void l2d::editor::drawpoint(const glm::vec2 &pt, const glm::vec4 &color)
-{
-	float thickness = 1.0 / m_zoom;
-	glm::vec2 mins = { pt.x - thickness * 3.0f, pt.y - thickness * 3.0f };
-	glm::vec2 maxs = { pt.x + thickness * 3.0f, pt.y + thickness * 3.0f };
+void l2d::editor::drawpoint(const glm::vec2 &pt, const glm::vec4 &color)
+{
+	s_gl->point(pt, 6.0f, BLACK); // outline
+	s_gl->point(pt, 4.0f, color); // foreground
+	s_gl->point(pt, 2.0f, BLACK); // center
+}
+
+
+void l2d::editor::outlinepoly(const glm::vec2 points[], size_t npoints, float thickness, const glm::vec4 &color)
+{
+	for(size_t i = 0; i < npoints; i++) {
+		glm::vec2 a = points[i];
+		glm::vec2 b = points[(i + 1) % npoints];
+		s_gl->line(a, b, thickness, color);
+	}
+}
+
+void l2d::editor::resetpolys()
+{
+	// the history creates and deletes every layer after the first
+	m_layers.clear();
+	m_layers.emplace_back(RED);
+	m_unlayers.clear();
+
+	m_checkpoints.clear();
+
+	for(size_t i = 0; i < m_history; i++) {
+		enact(i);
+		checkpoint(i + 1);
+	}
+
+	// every poly of the history has its id now
+	m_polyacts.clear();
+	for(size_t i = 0; i < m_indices.size(); i++) {
+		if(m_indices[i].poly != -1) {
+			indexpoly(i);
+		}
+	}
+}
+
+
+void l2d::editor::resetpoly(size_t i) 
+{
+	size_t from = 0;
+
+	for(auto cp = m_checkpoints.rbegin(); cp != m_checkpoints.rend(); cp++) {
+		if(cp->position > m_history) {
+			continue;
+		}
+
+		auto it = std::lower_bound(cp->polys.begin(), cp->polys.end(), i, 
+			[](const std::pair<uint32_t, poly2d> &entry, size_t poly) {
+				return entry.first < poly;
+			});
+
+		if(it != cp->polys.end() && it->first == i) {
+			m_polys[i] = it->second;
+			from = cp->position;
+			break;
+		}
+	}
+
+	if(i >= m_polyacts.size()) {
+		return;
+	}
+
+	// only this poly's own actions between the checkpoint and now
+	const std::vector<uint32_t> &acts = m_polyacts[i];
+	auto it = std::lower_bound(acts.begin(), acts.end(), from);
+	for(; it != acts.end() && *it < m_history; it++) {
+		act::index &act = m_indices[*it];
+		if(act.type == act::type::RECT) {
+			// the poly is already in its layer, only reset its shape
+			m_polys[i] = m_rects[act.index];
+			dirtypoly(i);
+		} else {
+			enact(*it);
+		}
+	}
+}
+
+
+#ifndef NDEBUG
+static bool samepoly(const poly2d &a, const poly2d &b)
+{
+	if(a.points().size() != b.points().size() || a.texindex != b.texindex || a.texscale != b.texscale) {
+		return false;
+	}
+
+	// squashed scales round differently than the steps they replace
+	for(size_t i = 0; i < a.points().size(); i++) {
+		glm::vec2 d = glm::abs(a.points()[i] - b.points()[i]);
+		if(d.x > 0.01f || d.y > 0.01f) {
+			return false;
+		}
+	}
+
+	return true;
+}
+#endif
+
+
+// rewrites the history into a shorter one ending in the same polys. the
+// actions of deleted polys and layers, textures replaced later on and
+// moves or scales of a poly that follow each other are squashed. like
+// any new action this drops the redo future.
+void l2d::editor::compact()
+{
+	struct entry {
+		act::index act;
+		uint8_t payload[sizeof(act::scale)];
+		size_t size;
+		// which layer act.layer pointed at, see below
+		uint32_t layerid;
+	};
+
+#ifndef NDEBUG
+	// the level as it is, checked against the replayed history at the end
+	std::vector<std::pair<glm::vec4, std::vector<poly2d>>> level;
+	for(const layer &layer : m_layers) {
+		auto &[color, polys] = level.emplace_back(layer.color, std::vector<poly2d>());
+		for(size_t i : layer.polys) {
+			polys.push_back(m_polys[i]);
+		}
+	}
+#endif
+
+	// act.layer is a position in the layer list at the time of the act,
+	// which shifts whenever a layer is deleted. give every layer an id,
+	// 0 for the first one and then in order of the LAYER acts, to know
+	// which acts belong to a deleted layer and renumber the rest.
+	std::vector<uint32_t> live = { 0 };
+	std::vector<uint32_t> layerids(m_history, -1);
+	std::vector<bool> deletedlayer(1, false);
+
+	size_t npolys = m_polys.size();
+	std::vector<bool> deleted(npolys, false);
+	std::vector<uint32_t> polylayer(npolys, -1);
+	std::vector<uint32_t> lasttexture(npolys, -1);
+
+	for(size_t i = 0; i < m_history; i++) {
+		const act::index &act = m_indices[i];
+
+		if(act.type == act::type::LAYER) {
+			layerids[i] = deletedlayer.size();
+			live.push_back(layerids[i]);
+			deletedlayer.push_back(false);
+		} else if(act.layer < live.size()) {
+			layerids[i] = live[act.layer];
+		}
+
+		if(act.type == act::type::DEL && act.poly == -1 && act.layer < live.size()) {
+			deletedlayer[live[act.layer]] = true;
+			live.erase(live.begin() + act.layer);
+		}
+
+		if(act.poly >= npolys) {
+			continue;
+		}
+
+		if(act.type == act::type::RECT) {
+			polylayer[act.poly] = layerids[i];
+		} else if(act.type == act::type::DEL) {
+			deleted[act.poly] = true;
+		} else if(act.type == act::type::TEXTURE) {
+			lasttexture[act.poly] = i;
+		}
+	}
+
+	// polys go with their layer
+	for(size_t poly = 0; poly < npolys; poly++) {
+		if(polylayer[poly] < deletedlayer.size() && deletedlayer[polylayer[poly]]) {
+			deleted[poly] = true;
+		}
+	}
+
+	// last kept entry of each poly
+	std::vector<uint32_t> last(npolys, -1);
+	std::vector<entry> entries;
+
+	for(size_t i = 0; i < m_history; i++) {
+		const act::index &act = m_indices[i];
+		bool polyact = act.poly < npolys;
+
+		if(polyact && deleted[act.poly]) {
+			continue;
+		}
+
+		// a deleted layer is dropped along with its creation. the first
+		// layer isn't created by an act, its delete has to stay.
+		if((act.type == act::type::LAYER || (act.type == act::type::DEL && !polyact)) &&
+		   layerids[i] != 0 && layerids[i] < deletedlayer.size() && deletedlayer[layerids[i]]) {
+			continue;
+		}
+
+		if(act.type == act::type::TEXTURE && lasttexture[act.poly] != i) {
+			continue;
+		}
+
+		entry e;
+		e.act = act;
+		e.size = getpayload(act, e.payload);
+		e.layerid = layerids[i];
 
-	s_gl->rect(mins, maxs, BLACK); // outline
-	mins += thickness; maxs -= thickness;
-	s_gl->rect(mins, maxs, color); // foreground
-	mins += thickness; maxs -= thickness;
-	s_gl->rect(mins, maxs, BLACK); // center
-}
+		entry *prev = polyact && last[act.poly] != -1 ? &entries[last[act.poly]] : nullptr;
 
+		if(prev != nullptr && act.type == act::type::MOVE && prev->act.type == act::type::MOVE) {
+			act::move a, b;
+			memcpy(&a, prev->payload, sizeof(act::move));
+			memcpy(&b, e.payload, sizeof(act::move));
+			a += b;
+			memcpy(prev->payload, &a, sizeof(act::move));
+			continue;
+		}
 
-void l2d::editor::outlinepoly(const glm::vec2 points[], size_t npoints, float thickness, const glm::vec4 &color)
-{
-	thickness /= m_zoom;
+		if(prev != nullptr && act.type == act::type::SCALE && prev->act.type == act::type::SCALE) {
+			act::scale a, b;
+			memcpy(&a, prev->payload, sizeof(act::scale));
+			memcpy(&b, e.payload, sizeof(act::scale));
+			if(a.origin == b.origin) {
+				a.numer *= b.numer;
+				a.denom *= b.denom;
+
+				glm::i32vec2 g;
+				g.x = std::gcd(a.numer.x, a.denom.x);
+				g.y = std::gcd(a.numer.y, a.denom.y);
+				a.numer /= g;
+				a.denom /= g;
+				memcpy(prev->payload, &a, sizeof(act::scale));
+				continue;
+			}
+		}
 
-	for(size_t i = 0; i < npoints; i++) {
-		glm::vec2 a = points[i];
-		glm::vec2 b = points[(i + 1) % npoints];
-		s_gl->line(a, b, thickness, color);
+		if(polyact) {
+			last[act.poly] = entries.size();
+		}
+		entries.push_back(e);
 	}
-}
 
-void l2d::editor::resetpolys()
-{
-	for(layer &layer : m_layers) {
-		layer.polys.clear();
+	// rebuild the index and payload arrays, polys are numbered again in
+	// the order they are created
+	m_indices.clear();
+	m_rects.clear();
+	m_lines.clear();
+	m_moves.clear();
+	m_scales.clear();
+	m_acttextures.clear();
+	m_actlayers.clear();
+
+	std::vector<uint32_t> polyids(npolys, -1);
+	uint32_t npolyids = 0;
+	live.assign(1, 0);
+
+	for(entry &e : entries) {
+		if(e.act.type == act::type::MOVE) {
+			act::move move;
+			memcpy(&move, e.payload, sizeof(act::move));
+			if(move == act::move(0, 0)) {
+				continue;
+			}
+		} else if(e.act.type == act::type::SCALE) {
+			act::scale scale;
+			memcpy(&scale, e.payload, sizeof(act::scale));
+			if(scale.numer == scale.denom) {
+				continue;
+			}
+		}
+
+		if(e.act.poly < npolys) {
+			if(e.act.type == act::type::RECT) {
+				polyids[e.act.poly] = npolyids++;
+			}
+			e.act.poly = polyids[e.act.poly];
+		}
+
+		// the layer's position in the list the shorter history builds
+		if(e.act.type == act::type::LAYER) {
+			live.push_back(e.layerid);
+		}
+		auto pos = std::find(live.begin(), live.end(), e.layerid);
+		if(pos != live.end()) {
+			e.act.layer = pos - live.begin();
+		}
+		if(e.act.type == act::type::DEL && e.act.poly == -1 && pos != live.end()) {
+			live.erase(pos);
+		}
+
+		setpayload(e.act, e.payload, e.size);
+		m_indices.push_back(e.act);
 	}
 
-	for(size_t i = 0; i < m_history; i++) {
-		enact(i);
+	m_history = m_indices.size();
+
+	// everything derived from the old history
+	m_unlines.clear();
+	m_unlinepoints.clear();
+	m_unlineplanes.clear();
+	m_untextures.clear();
+	m_sephints.clear();
+	dirtyhistory(0);
+
+	for(size_t i = npolyids; i < m_meshes.size(); i++) {
+		s_gl->freemesh(m_meshes[i]);
+	}
+	m_meshes.resize(std::min<size_t>(m_meshes.size(), npolyids));
+	for(gl::mesh &mesh : m_meshes) {
+		mesh.dirty = true;
 	}
-}
 
+	m_polys.clear();
+	resetpolys();
 
-void l2d::editor::resetpoly(size_t i) 
-{
-	for(size_t a = 0; a < m_history; a++) {
-		if(m_indices[a].poly == i) {
-			enact(a);
+#ifndef NDEBUG
+	// replaying the shorter history has to give the same level
+	assert(m_layers.size() == level.size());
+	for(size_t l = 0; l < m_layers.size(); l++) {
+		const auto &[color, polys] = level[l];
+		assert(m_layers[l].color == color);
+		assert(m_layers[l].polys.size() == polys.size());
+
+		// undoing a delete puts a poly back at the end of its layer, so
+		// the order can differ
+		std::vector<bool> matched(polys.size(), false);
+		for(size_t i : m_layers[l].polys) {
+			size_t j = 0;
+			while(j < polys.size() && (matched[j] || !samepoly(m_polys[i], polys[j]))) {
+				j++;
+			}
+			assert(j < polys.size());
+			matched[j] = true;
 		}
 	}
+#endif
+
+	m_selectedpoly = -1;
+	if(m_selectedlayer >= m_layers.size()) {
+		m_selectedlayer = -1;
+	}
+
+	invalidate(REDRAW_ALL);
 }
 
 
@@ -741,11 +1593,19 @@ void l2d::editor::enact(size_t i)
 	act::index &act = m_indices[i];
 
 	switch(act.type) {
-	case act::type::LINE:
+	case act::type::LINE: {
+		std::optional<poly2d> before;
+		if(act.index >= m_unlines.size() || !m_unlines[act.index].valid) {
+			before = m_polys[act.poly];
+		}
 		m_polys[act.poly].slice(m_lines[act.index]);
 		m_polys[act.poly].fitlines();
 		m_polys[act.poly].fitaabb();
+		if(before) {
+			saveunline(act, *before);
+		}
 		break;
+	}
 	case act::type::MOVE:
 		m_polys[act.poly].offset(m_moves[act.index]);
 		break;
@@ -759,20 +1619,27 @@ void l2d::editor::enact(size_t i)
 			// initial action
 			act.poly = m_polys.size();
 			m_polys.emplace_back(m_rects[act.index]);
+			indexpoly(i);
 		} else {
-			// redo action
+			// redo action, or the first enact after a load. polys
+			// of truncated futures keep their ids, fill the gaps.
+			while(m_polys.size() <= act.poly) {
+				m_polys.emplace_back(m_rects[act.index]);
+			}
 			m_polys[act.poly] = m_rects[act.index];
 		}
-		m_layers[act.layer].polys.push_back(act.poly);
+		m_layers[act.layer].addpoly(act.poly, m_polys[act.poly].aabb());
 		break;
 	case act::type::DEL:
 		if(act.poly == -1) {
+			m_unlayers.push_back(std::move(m_layers[act.layer]));
 			m_layers.erase(m_layers.begin() + act.layer);
 		} else if(act.layer != -1) {
 			m_layers[act.layer].rmpoly(act.poly);
 		}
 		break;
 	case act::type::TEXTURE:
+		saveuntexture(act);
 		m_polys[act.poly].texindex = m_acttextures[act.index].index;
 		m_polys[act.poly].texscale = m_acttextures[act.index].scale;
 		break;
@@ -782,16 +1649,144 @@ void l2d::editor::enact(size_t i)
 		break;
 	}
 
+	if(act.poly != -1) {
+		dirtypoly(act.poly);
+	}
 	m_selectedpoly = act.poly;
+	invalidate(REDRAW_GEOMETRY | REDRAW_HISTORY);
+}
+
+
+// the first time a LINE action is enacted keep what it cut off. a slice of
+// a convex poly removes one run of points and adds at most two, the rest
+// of the old points stay in order, so only the removed ones are stored.
+void l2d::editor::saveunline(const act::index &act, const poly2d &before)
+{
+	if(m_unlines.size() <= act.index) {
+		m_unlines.resize(act.index + 1);
+	}
+
+	const iline2d &plane = m_lines[act.index];
+	const poly2d &after = m_polys[act.poly];
+	const auto &old = before.points();
+	const size_t n = old.size();
+
+	act::unline &un = m_unlines[act.index];
+	un.valid = true;
+	un.size = n;
+	un.at = 0;
+	un.kept = 0;
+	un.points = m_unlinepoints.size();
+
+	// find the removed run, the same test clip keeps points by
+	size_t nremoved = 0, runs = 0;
+	for(size_t i = 0; i < n; i++) {
+		bool removed = plane.distnumer(old[i]) < 0;
+		bool prev = plane.distnumer(old[(i + n - 1) % n]) < 0;
+		nremoved += removed;
+		if(removed && !prev) {
+			un.at = i;
+			runs++;
+		}
+	}
+
+	if(nremoved != 0 && nremoved != n) {
+		// points clip emits before the first kept one
+		size_t first = (un.at + nremoved) % n;
+		for(size_t i = 0; i < first; i++) {
+			float da = plane.distnumer(old[i]);
+			float db = plane.distnumer(old[(i + 1) % n]);
+			un.kept += (da >= 0) + (da * db < 0);
+		}
+
+		// float noise can break the single run, keep everything then
+		bool ok = runs == 1 && un.kept < after.points().size();
+		for(size_t i = 0; ok && i < n - nremoved; i++) {
+			const glm::vec2 &p = after.points()[(un.kept + i) % after.points().size()];
+			ok = memcmp(&p, &old[(first + i) % n], sizeof(glm::vec2)) == 0;
+		}
+		if(!ok) {
+			un.at = 0;
+			un.kept = 0;
+			nremoved = n;
+		}
+	}
 
-	save();
+	un.npoints = nremoved;
+	for(size_t i = 0; i < nremoved; i++) {
+		m_unlinepoints.push_back(old[(un.at + i) % n]);
+	}
+
+	// fitlines keeps the surviving planes in order, the new one goes last
+	un.nplanesbefore = before.planes().size();
+	un.planes = m_unlineplanes.size();
+	size_t j = 0;
+	for(size_t i = 0; i < before.planes().size(); i++) {
+		const iline2d &p = before.planes()[i];
+		if(j < after.planes().size() && after.planes()[j] == p) {
+			j++;
+		} else {
+			m_unlineplanes.push_back({ p, static_cast<uint32_t>(i) });
+		}
+	}
+	un.nplanes = m_unlineplanes.size() - un.planes;
+}
+
+
+// puts the points and planes saveunline kept back into the sliced poly
+void l2d::editor::unslice(const act::index &act)
+{
+	const act::unline &un = m_unlines[act.index];
+	const poly2d &poly = m_polys[act.poly];
+	const auto &cur = poly.points();
+
+	poly2d::pointlist points;
+	for(size_t i = 0; i < un.size; i++) {
+		size_t j = (i + un.size - un.at) % un.size;
+		if(j < un.npoints) {
+			points.push_back(m_unlinepoints[un.points + j]);
+		} else {
+			points.push_back(cur[(un.kept + j - un.npoints) % cur.size()]);
+		}
+	}
+
+	poly2d::planelist planes;
+	const act::unplane *removed = m_unlineplanes.data() + un.planes;
+	size_t r = 0, j = 0;
+	for(size_t i = 0; i < un.nplanesbefore; i++) {
+		if(r < un.nplanes && removed[r].at == i) {
+			planes.push_back(removed[r++].plane);
+		} else {
+			planes.push_back(poly.planes()[j++]);
+		}
+	}
+
+	m_polys[act.poly].restore(points.data(), points.size(), planes.data(), planes.size());
+}
+
+
+void l2d::editor::saveuntexture(const act::index &act)
+{
+	if(m_untextures.size() <= act.index) {
+		m_untextures.resize(act.index + 1);
+	}
+
+	act::untexture &un = m_untextures[act.index];
+	if(un.valid) {
+		return;
+	}
+
+	const poly2d &poly = m_polys[act.poly];
+	un.index = poly.texindex;
+	un.scale = poly.texscale;
+	un.valid = true;
 }
 
 
 void l2d::editor::deletelayer()
 {
 	if(!m_layers.empty() && m_selectedlayer != -1) {
-		addindex(act::type::DEL, -1, m_selectedlayer, -1);
+		addindex(act::type::DEL, -1, m_selectedlayer);
 		enact(m_indices.size() - 1);
 		m_selectedpoly  = -1;
 		m_selectedlayer = -1;
@@ -805,8 +1800,20 @@ void l2d::editor::unact(size_t i)
 
 	switch(act.type) {
 	case act::type::TEXTURE:
+		if(act.index < m_untextures.size() && m_untextures[act.index].valid) {
+			const act::untexture &un = m_untextures[act.index];
+			m_polys[act.poly].texindex = un.index;
+			m_polys[act.poly].texscale = un.scale;
+		} else {
+			resetpoly(act.poly);
+		}
+		break;
 	case act::type::LINE:
-		resetpoly(act.poly);
+		if(act.index < m_unlines.size() && m_unlines[act.index].valid) {
+			unslice(act);
+		} else {
+			resetpoly(act.poly);
+		}
 		break;
 	case act::type::MOVE:
 		m_polys[act.poly].offset(-m_moves[act.index]);
@@ -826,11 +1833,21 @@ void l2d::editor::unact(size_t i)
 		m_layers.erase(m_layers.begin() + act.layer);
 		break;
 	case act::type::DEL:
-		m_layers[act.layer].polys.push_back(act.poly);
+		if(act.poly == -1) {
+			// the layer comes back with its polys as they were
+			m_selectedlayer = -1;
+			m_layers.insert(m_layers.begin() + act.layer, std::move(m_unlayers.back()));
+			m_unlayers.pop_back();
+		} else if(act.layer != -1) {
+			m_layers[act.layer].addpoly(act.poly, m_polys[act.poly].aabb());
+		}
 		break;
 	}
 
-	save();
+	if(act.poly != -1) {
+		dirtypoly(act.poly);
+	}
+	invalidate(REDRAW_GEOMETRY | REDRAW_HISTORY);
 }
 
 
@@ -862,18 +1879,31 @@ void l2d::editor::redo()
 
 
 
-act::index &l2d::editor::addindex(act::type type, size_t poly, size_t layer, size_t index)
+// the caller pushes the payload right after, it goes to the slot taken
+// here once the future and its payloads are gone
+act::index &l2d::editor::addindex(act::type type, size_t poly, size_t layer)
 {
 	// future will now be invalid
 	while(m_indices.size() > m_history) {
-		m_indices.pop_back();
+		popindex();
+	}
+
+	dirtyhistory(m_indices.size());
+
+	// the polys still match the history up to here
+	if(m_history % CHECKPOINT_INTERVAL == 0) {
+		checkpoint(m_history);
 	}
 
 	act::index &back = m_indices.emplace_back();
 	back.type = type;
 	back.poly = poly;
 	back.layer = layer;
-	back.index = index;
+	back.index = payloadslot(type);
+
+	if(poly != -1) {
+		indexpoly(m_indices.size() - 1);
+	}
 
 	m_history++;
 
@@ -888,7 +1918,7 @@ void l2d::editor::addlayer(const glm::vec4 &color)
 	act::layer layer;
 	layer.color = color;
 
-	act::index &back = addindex(act::type::LAYER, -1, -1, m_actlayers.size());
+	act::index &back = addindex(act::type::LAYER, -1, -1);
 	m_actlayers.push_back(layer);
 
 	enact(m_indices.size() - 1);
@@ -897,9 +1927,12 @@ void l2d::editor::addlayer(const glm::vec4 &color)
 
 void l2d::editor::lmouseup()
 {
+	invalidate(REDRAW_SELECTION);
+
 	switch(m_state) {
 	case state::SELECT | state::IN_EDIT:
 		m_state &= ~state::IN_EDIT;
+		m_sephints.clear();
 		break;
 	default:
 		break;
@@ -911,6 +1944,9 @@ bool l2d::editor::actstr(long i, int col, char buf[ACTSTR_LEN])
 {
 	glm::i32vec2 lt, rb;
 
+	// columns without text for this type come out empty
+	buf[0] = '\0';
+
 	act::index &index = m_indices[i];
 	if(col == 0) {
 		switch(index.type) {
@@ -973,8 +2009,128 @@ bool l2d::editor::actstr(long i, int col, char buf[ACTSTR_LEN])
 
 
 
+// drop the cached rows of every index from i on
+void l2d::editor::dirtyhistory(size_t i)
+{
+	// indices from i on have to be journaled again
+	m_jnlfrom = std::min(m_jnlfrom, i);
+
+	if(m_histrows.size() > i) {
+		m_histrows.resize(i);
+	}
+
+	// checkpoints taken after index i no longer match the history
+	while(!m_checkpoints.empty() && m_checkpoints.back().position > i) {
+		m_checkpoints.pop_back();
+	}
+}
+
+
+void l2d::editor::indexpoly(size_t position)
+{
+	uint32_t poly = m_indices[position].poly;
+	if(poly >= m_polyacts.size()) {
+		m_polyacts.resize(poly + 1);
+	}
+
+	m_polyacts[poly].push_back(position);
+}
+
+
+void l2d::editor::popindex()
+{
+	const act::index &act = m_indices.back();
+	uint32_t poly = act.poly;
+	if(poly < m_polyacts.size() && !m_polyacts[poly].empty() &&
+	   m_polyacts[poly].back() == m_indices.size() - 1) {
+		m_polyacts[poly].pop_back();
+	}
+
+	poppayload(act);
+	m_indices.pop_back();
+}
+
+
+// frees the payload of an index leaving the history. payloads are pushed
+// in the order of their indices, so it is normally the last one of its
+// array. files saved before payloads were freed can hold orphans after
+// it, then it is left where it is.
+void l2d::editor::poppayload(const act::index &act)
+{
+	uint32_t end = payloadslot(act.type);
+	if(end == 0 || end == -1 || act.index != end - 1) {
+		return;
+	}
+
+	switch(act.type) {
+	case act::type::LINE:
+		m_lines.pop_back();
+		if(act.index < m_unlines.size()) {
+			const act::unline &un = m_unlines[act.index];
+			if(un.valid && un.points + un.npoints == m_unlinepoints.size() &&
+			   un.planes + un.nplanes == m_unlineplanes.size()) {
+				m_unlinepoints.resize(un.points);
+				m_unlineplanes.resize(un.planes);
+			}
+			m_unlines.resize(act.index);
+		}
+		break;
+	case act::type::RECT:
+		m_rects.pop_back();
+		break;
+	case act::type::MOVE:
+		m_moves.pop_back();
+		break;
+	case act::type::SCALE:
+		m_scales.pop_back();
+		break;
+	case act::type::TEXTURE:
+		m_acttextures.pop_back();
+		if(act.index < m_untextures.size()) {
+			m_untextures.resize(act.index);
+		}
+		break;
+	case act::type::LAYER:
+		m_actlayers.pop_back();
+		break;
+	case act::type::DEL:
+		break;
+	}
+}
+
+
+// called with the polys matching the first `position` indices
+void l2d::editor::checkpoint(size_t position)
+{
+	size_t last = m_checkpoints.empty() ? 0 : m_checkpoints.back().position;
+	if(position < last + CHECKPOINT_INTERVAL) {
+		return;
+	}
+
+	std::vector<uint32_t> touched;
+	for(size_t a = last; a < position; a++) {
+		uint32_t poly = m_indices[a].poly;
+		if(poly < m_polys.size()) {
+			touched.push_back(poly);
+		}
+	}
+
+	std::sort(touched.begin(), touched.end());
+	touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+
+	checkpoint_t &cp = m_checkpoints.emplace_back();
+	cp.position = position;
+	cp.polys.reserve(touched.size());
+	for(uint32_t poly : touched) {
+		cp.polys.emplace_back(poly, m_polys[poly]);
+	}
+}
+
+
 void l2d::editor::lmousedown()
 {
+	invalidate(REDRAW_SELECTION);
+
 	if(ui_lmousedown()) {
 		return;
 	}
@@ -990,11 +2146,8 @@ void l2d::editor::lmousedown()
 
 	switch(m_state) {
 	case state::TEXTURE:
-		for(size_t i : layer.polys) {
-			if(m_polys[i].contains(m_wpos)) {
-				m_selectedpoly = i;
-				break;
-			}
+		if(size_t i = polyat(layer, m_wpos); i != -1) {
+			m_selectedpoly = i;
 		}
 		if(m_selectedpoly != -1 && m_selectedtexture != -1) {
 			act::texture act;
@@ -1012,24 +2165,23 @@ void l2d::editor::lmousedown()
 				}
 			}
 
-			act::index &back = addindex(act::type::TEXTURE, m_selectedpoly, m_selectedlayer, m_acttextures.size());
+			act::index &back = addindex(act::type::TEXTURE, m_selectedpoly, m_selectedlayer);
 			m_acttextures.push_back(act);
 
 			enact(m_indices.size() - 1);
-			save();
 		}
 		break;
 	case state::SELECT:
 	case state::SELECT | state::IN_EDIT:
-		for(size_t i : layer.polys) {
-			if(m_polys[i].contains(m_wpos)) {
-				m_selectedpoly = i;
-			}
+		if(size_t i = polyat(layer, m_wpos); i != -1) {
+			m_selectedpoly = i;
 		}
 		if(m_selectedpoly != -1) {
 			selected = &m_polys[m_selectedpoly];
 			const irect2d &aabb = selected->aabb();
 			m_state |= state::IN_EDIT;
+			// hints of the previous drag belong to another poly
+			m_sephints.assign(m_polys.size(), sephint());
 			m_outcode = aabb.outcode(m_wpos);
 			m_start = s_gl->snaptogrid(m_wpos);
 			glm::i32vec2 opposite;
@@ -1050,6 +2202,10 @@ void l2d::editor::lmousedown()
 
 				ocpts(aabb, m_outcode, m_start, opposite);
 				m_delta = opposite - m_start;
+
+				if(m_state & state::IN_EDIT) {
+					scalerange(m_layers[m_selectedlayer], m_selectedpoly);
+				}
 			} else {
 				m_start = m_wpos;
 				m_state |= state::IN_EDIT;
@@ -1059,13 +2215,7 @@ void l2d::editor::lmousedown()
 		break;
 
 	case state::RECT: // 1st click
-		for(size_t i : m_layers[m_selectedlayer].polys) {
-			const poly2d &poly = m_polys[i];
-			if(poly.contains(m_wpos)) {
-				intersects = true;
-				break;
-			}
-		}
+		intersects = polyat(layer, m_wpos) != -1;
 		if(!intersects) {
 			m_end = m_start;
 			m_state |= state::IN_EDIT;
@@ -1075,18 +2225,11 @@ void l2d::editor::lmousedown()
 
 	case state::RECT | state::IN_EDIT: { // 2nd click
 		irect2d r = irect2d(m_start, m_end);
-		for(size_t i : m_layers[m_selectedlayer].polys) {
-			const poly2d &poly = m_polys[i];
-			if(poly.intersects(r)) {
-				intersects = true;
-				break;
-			}
-		}
+		intersects = overlaps(layer, r);
 		if(!intersects) {
-			act::index &back = addindex(act::type::RECT, -1, m_selectedlayer, m_rects.size());
+			act::index &back = addindex(act::type::RECT, -1, m_selectedlayer);
 			m_rects.push_back(r);
 			enact(m_indices.size() - 1);
-			save();
 			// reset flags
 			m_state &= ~state::IN_EDIT;
 			m_start = s_gl->snaptogrid(m_wpos);
@@ -1119,10 +2262,9 @@ void l2d::editor::lmousedown()
 		break;
 
 	case state::LINE_SLICE:
-		act::index &back = addindex(act::type::LINE, m_selectedpoly, m_selectedlayer, m_lines.size());
+		act::index &back = addindex(act::type::LINE, m_selectedpoly, m_selectedlayer);
 		m_lines.push_back(m_plane);
 		enact(m_indices.size() - 1);
-		save();
 		m_state = state::LINE_START_POINT;
 		break;
 	}
@@ -1130,6 +2272,8 @@ void l2d::editor::lmousedown()
 
 void l2d::editor::rmousedown()
 {
+	invalidate(REDRAW_SELECTION);
+
 	poly2d *selected = nullptr;
 	if(m_selectedlayer == -1) {
 		return;
@@ -1139,11 +2283,8 @@ void l2d::editor::rmousedown()
 
 	switch(m_state) {
 	case state::TEXTURE:
-		for(size_t i : layer.polys) {
-			if(m_polys[i].contains(m_wpos)) {
-				m_selectedpoly = i;
-				break;
-			}
+		if(size_t i = polyat(layer, m_wpos); i != -1) {
+			m_selectedpoly = i;
 		}
 		if(m_selectedpoly != -1) {
 			act::texture act;
@@ -1163,19 +2304,15 @@ void l2d::editor::rmousedown()
 				}
 			}
 
-			act::index &back = addindex(act::type::TEXTURE, m_selectedpoly, m_selectedlayer, m_acttextures.size());
+			act::index &back = addindex(act::type::TEXTURE, m_selectedpoly, m_selectedlayer);
 			m_acttextures.push_back(act);
 
 			enact(m_indices.size() - 1);
-			save();
 		}
 		break;
 	case state::SELECT:
-		for(size_t i : layer.polys) {
-			if(m_polys[i].contains(m_wpos)) {
-				m_selectedpoly = i;
-				break;
-			}
+		if(size_t i = polyat(layer, m_wpos); i != -1) {
+			m_selectedpoly = i;
 		}
 		break;
 	case state::LINE_SLICE:
@@ -1198,9 +2335,13 @@ void l2d::editor::key(int key, int scancode, int action, int mods)
 		return;
 	}
 
-	if(key == GLFW_KEY_DELETE) {
+	invalidate(REDRAW_SELECTION);
+
+	if(key == GLFW_KEY_F3) {
+		s_gl->profile(!s_gl->profiling());
+	} else if(key == GLFW_KEY_DELETE) {
 		if(m_selectedpoly != -1 && m_selectedlayer != -1) {
-			addindex(act::type::DEL, m_selectedpoly, m_selectedlayer, -1);
+			addindex(act::type::DEL, m_selectedpoly, m_selectedlayer);
 			enact(m_indices.size() - 1);
 			m_selectedpoly = -1;
 		}
@@ -1208,13 +2349,21 @@ void l2d::editor::key(int key, int scancode, int action, int mods)
 		switch(key) {
 		case GLFW_KEY_Z: undo(); break;
 		case GLFW_KEY_Y: redo(); break;
+		case GLFW_KEY_K: compact(); break;
+		case GLFW_KEY_S:
+			// shift compacts the history into the saved file
+			if(mods & GLFW_MOD_SHIFT) {
+				compact();
+			}
+			save();
+			break;
 		default: break;
 		}
 	}
 }
 
 
-bool l2d::editor::ui_findtool(bool set_state)
+int l2d::editor::ui_toolat(const glm::vec2 &mpos) const
 {
 	static constexpr int PAD_X = 4;
 	static constexpr int PAD_Y = 4;
@@ -1227,15 +2376,27 @@ bool l2d::editor::ui_findtool(bool set_state)
 
 		irect2d r{ mins, maxs };
 
-		if(r.contains(m_mpos)) {
-			if(set_state) {
-				m_state = i;
-			}
-			return true;
+		if(r.contains(mpos)) {
+			return i;
 		}
 	}
 
-	return false;
+	return -1;
+}
+
+
+bool l2d::editor::ui_findtool(bool set_state)
+{
+	int i = ui_toolat(m_mpos);
+	if(i == -1) {
+		return false;
+	}
+
+	if(set_state) {
+		m_state = i;
+	}
+
+	return true;
 }
 
 
@@ -1249,6 +2410,26 @@ bool l2d::editor::ui_mmotion()
 }
 
 
+bool l2d::editor::ui_mwheel(double yoffs)
+{
+	if(m_mpos.x < m_width - HLIST_WIDTH) {
+		return false;
+	}
+
+	size_t rows = std::max(m_height - HLIST_PAD_Y, 0) / HLIST_ROW_HEIGHT;
+	size_t maxscroll = m_indices.size() > rows ? m_indices.size() - rows : 0;
+
+	if(yoffs > 0 && m_histscroll > 0) { /* towards newer */
+		m_histscroll -= std::min<size_t>(m_histscroll, 3);
+	} else if(yoffs < 0) { /* towards older */
+		m_histscroll = std::min(m_histscroll + 3, maxscroll);
+	}
+
+	invalidate(REDRAW_HISTORY);
+	return true;
+}
+
+
 bool l2d::editor::ui_lmousedown()
 {
 	if(ui_findtool(&m_state)) {
@@ -1260,10 +2441,51 @@ bool l2d::editor::ui_lmousedown()
 }
 
 
+void l2d::editor::ui_drawstats(const glm::vec2 &pos)
+{
+	static constexpr int LINE_HEIGHT = 14;
+	static constexpr int LINES = 5;
+
+	const gl::framestats &stats = s_gl->stats();
+
+	size_t n = std::min(m_framesample, FRAME_SAMPLES);
+	float avg = 0.0f, max = 0.0f;
+	for(size_t i = 0; i < n; i++) {
+		avg += m_frame_ms[i];
+		max = std::max(max, m_frame_ms[i]);
+	}
+	avg = n != 0 ? avg / n : 0.0f;
+
+	s_gl->rect(pos, pos + glm::vec2(220, LINES * LINE_HEIGHT + 6), glm::vec4(0.0f, 0.0f, 0.0f, 0.6f));
+
+	char buf[128];
+	glm::vec2 p = pos + glm::vec2(4, LINE_HEIGHT);
+
+	snprintf(buf, sizeof(buf), "paint %.2f ms avg %.2f max", avg, max);
+	s_gl->puts(p, WHITE, buf);
+	p.y += LINE_HEIGHT;
+	snprintf(buf, sizeof(buf), "motion %.3f ms", m_framemotion_ms);
+	s_gl->puts(p, WHITE, buf);
+	p.y += LINE_HEIGHT;
+	snprintf(buf, sizeof(buf), "gpu grid %.2f tex %.2f solid %.2f",
+	         stats.gpu_ms[gl::PASS_GRID],
+	         stats.gpu_ms[gl::PASS_TEXTURED],
+	         stats.gpu_ms[gl::PASS_SOLID]);
+	s_gl->puts(p, WHITE, buf);
+	p.y += LINE_HEIGHT;
+	snprintf(buf, sizeof(buf), "draws %u vertices %u", stats.draws, stats.vertices);
+	s_gl->puts(p, WHITE, buf);
+	p.y += LINE_HEIGHT;
+	snprintf(buf, sizeof(buf), "streamed %zu kb", stats.bytes / 1024);
+	s_gl->puts(p, WHITE, buf);
+}
+
+
 void l2d::editor::ui_draw()
 {
 	static glm::mat4 id{ 1 };
 	s_gl->setmatrices(m_proj, id);
+	s_gl->begin();
 
 	glm::vec2 size;
 	size.x = static_cast<float>(m_width);
@@ -1286,8 +2508,8 @@ void l2d::editor::ui_draw()
 		ia::pawn
 	};
 
+	// highlights go under the icons, flush them before any icon is batched
 	for(int i = 0; i < 5; i++) {
-		// select tool
 		glm::i32vec2 mins = { PAD_X, 
 		                      PAD_Y + i * yoffs };
 
@@ -1298,38 +2520,72 @@ void l2d::editor::ui_draw()
 
 		if(r.contains(m_mpos)) {
 			s_gl->rect(mins, maxs, glm::vec4(0.0f, 0.5f, 1.0f, 0.2f));
-			outlinerect(r, m_zoom, glm::vec4(0.0f, 0.5f, 1.0f, 0.5f));
-			// drop shadow
-			s_gl->icon(mins + 1, state_icon[i], glm::vec4(0.0f, 0.0f, 0.0f, 0.5f));
+			outlinerect(r, 1.0f, glm::vec4(0.0f, 0.5f, 1.0f, 0.5f));
 		}
 
 		if(i == (m_state & TOOL_MASK)) { // icon is selected
 			s_gl->rect(mins, maxs, glm::vec4(0.0f, 0.5f, 1.0f, 0.5f));
+		}
+	}
+
+	s_gl->end();
+
+	for(int i = 0; i < 5; i++) {
+		glm::i32vec2 mins = { PAD_X, 
+		                      PAD_Y + i * yoffs };
+
+		glm::i32vec2 maxs = { mins.x + state_icon[i].w + 1, 
+		                      mins.y + state_icon[i].h + 1 };
+
+		irect2d r = { mins, maxs };
+
+		// drop shadow
+		if(r.contains(m_mpos) || i == (m_state & TOOL_MASK)) {
 			s_gl->icon(mins + 1, state_icon[i], glm::vec4(0.0f, 0.0f, 0.0f, 0.5f));
 		}
 
 		s_gl->icon(mins, state_icon[i], WHITE);
 	}
 
-	constexpr int HLIST_WIDTH = 300;
-	constexpr int HLIST_PAD_X = 20;
-	constexpr int HLIST_PAD_Y = 10;
-
-	float xofs = size.x - 300;
+	float xofs = size.x - HLIST_WIDTH;
 	s_gl->rect({xofs - 1, 0 }, { size.x, size.y }, BLACK);
 	s_gl->rect({xofs, 0}, { size.x, size.y }, PASTEL_PINK);
-	
-	char buf[256];
-	for(size_t i = 0; i < m_indices.size(); i++) {
-		dy = m_indices.size() - i;
+
+	static constexpr float col_x[4] = { 0, 140, 60, 100 };
+
+	// newest index on top, only the rows that fit are laid out and drawn
+	size_t rows = std::max(m_height - HLIST_PAD_Y, 0) / HLIST_ROW_HEIGHT;
+	size_t maxscroll = m_indices.size() > rows ? m_indices.size() - rows : 0;
+	m_histscroll = std::min(m_histscroll, maxscroll);
+
+	if(m_histrows.size() < m_indices.size()) {
+		m_histrows.resize(m_indices.size());
+	}
+
+	char buf[ACTSTR_LEN];
+	for(size_t r = 0; r < rows && r + m_histscroll < m_indices.size(); r++) {
+		size_t i = m_indices.size() - 1 - m_histscroll - r;
+		histrow &row = m_histrows[i];
+
+		if(!row.valid) {
+			for(int col = 0; col < 4; col++) {
+				actstr(i, col, buf);
+				s_gl->layout(row.cols[col], buf);
+			}
+			row.valid = true;
+		}
+
+		dy = r + 1;
 		glm::vec4 color = i >= m_history ? RED : BLACK;
-		actstr(i, 0, buf);
-		s_gl->puts({ xofs + HLIST_PAD_X,       HLIST_PAD_Y + dy * 14 }, color, buf);
-		actstr(i, 2, buf);
-		s_gl->puts({ xofs + HLIST_PAD_X + 60,  HLIST_PAD_Y + dy * 14 }, color, buf);
-		actstr(i, 3, buf);
-		s_gl->puts({ xofs + HLIST_PAD_X + 100, HLIST_PAD_Y + dy * 14 }, color, buf);
-		actstr(i, 1, buf);
-		s_gl->puts({ xofs + HLIST_PAD_X + 140, HLIST_PAD_Y + dy * 14 }, color, buf);
+		for(int col = 0; col < 4; col++) {
+			glm::vec2 pos = { xofs + HLIST_PAD_X + col_x[col], HLIST_PAD_Y + dy * HLIST_ROW_HEIGHT };
+			s_gl->puts(pos, color, row.cols[col]);
+		}
+	}
+
+	if(s_gl->profiling()) {
+		ui_drawstats({ tb_width + 10, 10 });
 	}
+
+	s_gl->end();
 }
@@ -2,6 +2,7 @@
 #define _EDITORCONTEXT_HPP
 
 #include <vector>
+#include <future>
 
 #include <glm/fwd.hpp>
 
@@ -11,6 +12,7 @@
 #include "src/gl/texture.hpp"
 #include "src/gl/glcontext.hpp"
 #include "src/geometry.hpp"
+#include "src/edit/polygrid.hpp"
 
 constexpr glm::vec2 MAX_PAN = { 1000.0f,  1000.0f };
 constexpr glm::vec2 MIN_PAN = { -1000.0f, -1000.0f };
@@ -18,6 +20,12 @@ constexpr float MAX_ZOOM = 150.0f;
 constexpr float MIN_ZOOM = 5.0f;
 
 constexpr size_t ACTSTR_LEN = 128;
+constexpr int HLIST_WIDTH = 300;
+constexpr int HLIST_PAD_X = 20;
+constexpr int HLIST_PAD_Y = 10;
+constexpr int HLIST_ROW_HEIGHT = 14;
+constexpr size_t FRAME_SAMPLES = 64;
+constexpr size_t CHECKPOINT_INTERVAL = 64;
 
 namespace act {
 enum class type : int32_t {
@@ -50,18 +58,52 @@ struct index {
 struct layer {
 	glm::vec4 color;
 };
+/* what a LINE action cut off its poly, set the first time it is enacted.
+   the removed points are a run starting at point at of the old poly, the
+   old points after that run start at point kept of the sliced one. the
+   removed points and planes live in flat side arrays. */
+struct unline {
+	uint32_t points = 0;
+	uint32_t npoints = 0;
+	uint32_t at = 0;
+	uint32_t kept = 0;
+	// point and plane counts before the slice
+	uint32_t size = 0;
+	uint32_t nplanesbefore = 0;
+	uint32_t planes = 0;
+	uint32_t nplanes = 0;
+	bool valid = false;
+};
+/* a plane a LINE action dropped and its index in the old poly */
+struct unplane {
+	iline2d plane;
+	uint32_t at;
+};
+/* texture a TEXTURE action replaced */
+struct untexture {
+	int32_t index;
+	int32_t scale;
+	bool valid = false;
+};
 };
 
 namespace l2d {
 struct layer {
 	layer(const glm::vec4 &color)
 		: color(color), polys() {}
+	void addpoly(size_t i, const irect2d &aabb)
+	{
+		polys.push_back(i);
+		grid.insert(i, aabb);
+	}
 	void rmpoly(size_t i)
 	{
 		polys.erase(std::remove(polys.begin(), polys.end(), i), polys.end());
+		grid.remove(i);
 	}
 	glm::vec4 color;
 	std::vector<size_t> polys;
+	polygrid grid;
 };
 
 struct editor {
@@ -86,20 +128,64 @@ struct editor {
 		LINE_SLICE = LINE | (1 << 4)
 	};
 
+	// what has to be repainted, paint() is skipped while this is empty
+	enum redraw : uint32_t {
+		REDRAW_VIEW = 1 << 0,
+		REDRAW_GEOMETRY = 1 << 1,
+		REDRAW_HOVER = 1 << 2,
+		REDRAW_SELECTION = 1 << 3,
+		REDRAW_HISTORY = 1 << 4,
+		REDRAW_ALL = 0x1f
+	};
+
+	// everything the cursor position changes on screen
+	struct hover {
+		int tool;
+		int outcode;
+		bool highlight;
+		glm::i32vec2 gpos;
+		bool operator==(const hover &other) const
+		{
+			return tool == other.tool && outcode == other.outcode &&
+			       highlight == other.highlight && gpos == other.gpos;
+		}
+	};
+
+	void invalidate(uint32_t what) { m_redraw |= what; }
+	bool needspaint();
+	hover gethover() const;
+	bool handlehover(const irect2d &aabb, int &oc) const;
+
 	bool actstr(long i, int col, char buf[ACTSTR_LEN]);
+	void dirtyhistory(size_t i);
+	void indexpoly(size_t position);
+	void saveunline(const act::index &act, const poly2d &before);
+	void unslice(const act::index &act);
+	void saveuntexture(const act::index &act);
+	void popindex();
+	void poppayload(const act::index &act);
+	void checkpoint(size_t position);
 
 	void enact(size_t i);
 	void unact(size_t i);
 
-	act::index &addindex(act::type type, size_t poly, size_t layer, size_t index);
+	act::index &addindex(act::type type, size_t poly, size_t layer);
 	void addtexture(const char *path);
 	void addlayer(const glm::vec4 &color);
 	void deletelayer();
 	void undo();
 	void redo();
+	void compact();
 	bool save();
 	bool save(const char *path);
 	bool load(const char *path);
+	void autosave(bool force = false);
+	void finishsave(bool wait);
+	bool autosavepending() const;
+	bool replay();
+	uint32_t payloadslot(act::type type) const;
+	size_t getpayload(const act::index &act, uint8_t out[]) const;
+	bool setpayload(act::index &act, const uint8_t payload[], size_t size);
 	void resetpoly(size_t i);
 	void resetpolys();
 
@@ -110,10 +196,19 @@ struct editor {
 	void drawpoint(const glm::vec2 &point, const glm::vec4 &color);
 	void drawline(const glm::vec2 &a, const glm::vec2 &b, float thickness, const glm::vec4 &color);
 	void drawpoly(const poly2d *p);
+	void dirtypoly(size_t i);
 
 	// matrices
 	void zoom(glm::vec2 origin, float scale);
 	glm::vec2 worldtoscreen(glm::vec2 world) const;
+	irect2d viewrect() const;
+	void querypolys(const layer &layer, const irect2d &r, std::vector<size_t> &out) const;
+	size_t polyat(const layer &layer, const glm::vec2 &pt) const;
+	bool overlaps(const layer &layer, const irect2d &r) const;
+	bool overlaps(const layer &layer, const poly2d &poly, size_t ignore) const;
+	glm::i32vec2 sweepmove(const layer &layer, size_t poly, const glm::i32vec2 &delta);
+	void scalerange(const layer &layer, size_t poly);
+	bool collides(const layer &layer, size_t poly);
 	glm::vec2 screentoworld(glm::vec2 screen) const;
 
 	void setupview();
@@ -121,9 +216,12 @@ struct editor {
 
 	// ui overlay
 	void ui_draw();
+	int ui_toolat(const glm::vec2 &mpos) const;
 	bool ui_findtool(bool set_state = false);
 	bool ui_lmousedown();
 	bool ui_mmotion();
+	bool ui_mwheel(double yoffs);
+	void ui_drawstats(const glm::vec2 &pos);
 
 	static constexpr int SELECTION_THRESHOLD = 12;
 
@@ -143,6 +241,8 @@ struct editor {
 	// key events
 	void key(int key, int scancode, int action, int mods);
 private:
+	friend struct file;
+
 	glm::vec2 m_mpos; // last known screen pos of cursor
 	glm::vec2 m_wpos; // last known world pos of cursor
 	int m_width;
@@ -152,10 +252,17 @@ private:
 	glm::mat4 m_view;
 	glm::mat4 m_proj;
 
+	uint32_t m_redraw = REDRAW_ALL;
+	std::vector<size_t> m_visible;
+	hover m_hover = {};
+
 	std::vector<layer> m_layers;
 	std::vector<poly2d> m_polys;
 	std::vector<gl::texture> m_textures;
 
+	// cached outline and fill of every unselected poly
+	std::vector<gl::mesh> m_meshes;
+
 	uint32_t m_selectedpoly = -1;
 	uint32_t m_selectedlayer = -1;
 	uint32_t m_selectedtexture = -1;
@@ -168,11 +275,47 @@ private:
 	std::vector<act::texture> m_acttextures;
 	std::vector<act::layer> m_actlayers;
 
+	// inverse state, indexed like m_lines and m_acttextures
+	std::vector<act::unline> m_unlines;
+	std::vector<glm::vec2> m_unlinepoints;
+	std::vector<act::unplane> m_unlineplanes;
+	std::vector<act::untexture> m_untextures;
+	// layers taken out by the layer DEL actions up to m_history, in order
+	std::vector<layer> m_unlayers;
+
 	// [0..history]    --> history
 	// [history..size] --> future
 	std::vector<act::index> m_indices;
 	uint32_t m_history = 0;
 
+	// history panel, one laid out row per index. rows are built when
+	// they first scroll into view and dropped when their action changes.
+	struct histrow {
+		gl::textrun cols[4];
+		bool valid = false;
+	};
+	std::vector<histrow> m_histrows;
+	size_t m_histscroll = 0;
+
+	// poly state after the first `position` indices, only holding the
+	// polys touched since the previous checkpoint. a poly is restored
+	// from the newest checkpoint holding it and only the tail replayed.
+	struct checkpoint_t {
+		size_t position;
+		std::vector<std::pair<uint32_t, poly2d>> polys;
+	};
+	std::vector<checkpoint_t> m_checkpoints;
+
+	// ascending positions in m_indices of the actions on each poly
+	std::vector<std::vector<uint32_t>> m_polyacts;
+
+	// cpu timings for the stats overlay, in milliseconds
+	float m_paint_ms = 0.0f;
+	float m_motion_ms = 0.0f;
+	float m_frame_ms[FRAME_SAMPLES] = {};
+	float m_framemotion_ms = 0.0f;
+	size_t m_framesample = 0;
+
 	// current tool
 	uint32_t m_state;
 
@@ -187,6 +330,11 @@ private:
 	// select edit
 	int m_outcode;
 	glm::i32vec2 m_delta;
+	glm::i32vec2 m_scalemin;
+	glm::i32vec2 m_scalemax;
+	// last separating axis of the dragged poly against each neighbour,
+	// by poly id. only held while a drag is on.
+	std::vector<sephint> m_sephints;
 
 	// zoom/pan ctrl
 	bool m_panning = false;
@@ -196,6 +344,16 @@ private:
 	std::string m_name;
 	std::string m_path = {};
 
+	// history since the last full save, appended next to m_path
+	journal m_journal;
+	// first index changed since the last autosave, -1 when none
+	size_t m_jnlfrom = -1;
+	// textures already in the file or the journal
+	size_t m_jnltextures = 0;
+	// bumped by every save, the journal records which file it extends
+	uint32_t m_stamp = 0;
+	std::shared_future<bool> m_saving;
+
 	static gl::ctx *s_gl;
 };
 };
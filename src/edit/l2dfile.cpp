@@ -1,144 +1,561 @@
 #include <cstring>
+#include <cstdio>
+#include <filesystem>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 #include "src/edit/editorcontext.hpp"
 #include "src/edit/l2dfile.hpp"
 
+// the on-disk structs are little-endian and used in place
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#error "l2d files are little-endian"
+#endif
+
 namespace l2d {
 struct lump {
 	uint32_t ofs, size;
 };
 struct header {
 	uint8_t magic[2];
+	uint8_t version;
+	uint8_t pad;
 	lump actions;
 	lump texinfo;
 	lump texdata;
 	lump strings;
 };
+/* start of the actions lump, the arrays follow in this order */
+struct actions {
+	// matched against the journal, see l2d::journal
+	uint32_t stamp;
+	uint32_t history;
+	uint32_t indices;
+	uint32_t rects;
+	uint32_t lines;
+	uint32_t moves;
+	uint32_t scales;
+	uint32_t textures;
+	uint32_t layers;
+};
+
+static_assert(sizeof(header) == 36);
+static_assert(sizeof(texinfo) == 24);
+static_assert(sizeof(actions) == 36);
 }
 
 
-bool l2d::file::load(const char *filename)
+static uint32_t align(uint32_t ofs)
 {
+	return (ofs + l2d::file::ALIGN - 1) & ~(l2d::file::ALIGN - 1);
+}
+
+
+// maps a file read-only, it stays mapped while a reference is held
+static std::shared_ptr<const uint8_t[]> mapfile(const char *filename, size_t &size)
+{
+#ifdef _WIN32
+	// a mapped file can't be replaced by the rename in file::save, read
+	// it instead
 	FILE *fp = fopen(filename, "rb");
 	if(fp == nullptr) {
+		return nullptr;
+	}
+
+	fseek(fp, 0, SEEK_END);
+	long end = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+
+	size = end > 0 ? end : 0;
+	std::shared_ptr<uint8_t[]> data(new uint8_t[size]);
+	size = fread(data.get(), 1, size, fp);
+	fclose(fp);
+
+	return data;
+#else
+	int fd = open(filename, O_RDONLY);
+	if(fd == -1) {
+		return nullptr;
+	}
+
+	struct stat st;
+	if(fstat(fd, &st) == -1 || st.st_size == 0) {
+		close(fd);
+		return nullptr;
+	}
+
+	size = st.st_size;
+	void *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if(p == MAP_FAILED) {
+		return nullptr;
+	}
+
+	return std::shared_ptr<const uint8_t[]>(static_cast<const uint8_t *>(p),
+		[size](const uint8_t *data) { munmap(const_cast<uint8_t *>(data), size); });
+#endif
+}
+
+
+static bool inside(const l2d::lump &lump, size_t size)
+{
+	return lump.ofs <= size && lump.size <= size - lump.ofs;
+}
+
+
+template<typename T>
+static void putarray(std::vector<uint8_t> &out, const std::vector<T> &v)
+{
+	size_t ofs = out.size();
+	out.resize(ofs + v.size() * sizeof(T));
+	memcpy(out.data() + ofs, v.data(), v.size() * sizeof(T));
+}
+
+
+template<typename T>
+static bool getarray(const std::vector<uint8_t> &in, size_t &ofs, uint32_t n, std::vector<T> &v)
+{
+	size_t nbytes = n * sizeof(T);
+	if(ofs + nbytes > in.size()) {
 		return false;
 	}
-	
+
+	v.resize(n);
+	memcpy(v.data(), in.data() + ofs, nbytes);
+	ofs += nbytes;
+	return true;
+}
+
+
+bool l2d::file::load(const char *filename)
+{
+	size_t size = 0;
+	std::shared_ptr<const uint8_t[]> map = mapfile(filename, size);
+	if(map == nullptr || size < sizeof(header)) {
+		return false;
+	}
+
+	const uint8_t *base = map.get();
+
 	l2d::header hdr;
-	fseek(fp, 0, SEEK_SET);
-	fread(&hdr, sizeof(header), 1, fp);
+	memcpy(&hdr, base, sizeof(header));
 
-	if(hdr.magic[0] != 'L' && hdr.magic[1] != '2') {
-		fclose(fp);
+	if(hdr.magic[0] != 'L' || hdr.magic[1] != '2' || hdr.version != VERSION) {
 		return false;
 	}
-	
-	m_actiondata.resize(hdr.actions.size);
-	fseek(fp, hdr.actions.ofs, SEEK_SET);
-	fread(m_actiondata.data(), hdr.actions.size, 1, fp);
 
-	m_texinfo.resize(hdr.texinfo.size / sizeof(texinfo));
-	fseek(fp, hdr.texinfo.ofs, SEEK_SET);
-	fread(m_texinfo.data(), hdr.texinfo.size, 1, fp);
+	if(!inside(hdr.actions, size) || !inside(hdr.texinfo, size) ||
+	   !inside(hdr.texdata, size) || !inside(hdr.strings, size)) {
+		return false;
+	}
 
-	m_texdata.resize(hdr.texdata.size);
-	fseek(fp, hdr.texdata.ofs, SEEK_SET);
-	fread(m_texdata.data(), hdr.texdata.size, 1, fp);
+	// the small lumps are copied, the pixels stay in the mapping
+	m_actiondata.assign(base + hdr.actions.ofs, base + hdr.actions.ofs + hdr.actions.size);
+	m_strings.assign(base + hdr.strings.ofs, base + hdr.strings.ofs + hdr.strings.size);
 
-	m_strings.resize(hdr.strings.size);
-	fseek(fp, hdr.strings.ofs, SEEK_SET);
-	fread(m_strings.data(), hdr.strings.size, 1, fp);
+	m_texinfo.resize(hdr.texinfo.size / sizeof(texinfo));
+	memcpy(m_texinfo.data(), base + hdr.texinfo.ofs, m_texinfo.size() * sizeof(texinfo));
+
+	m_texdata.clear();
+	for(const texinfo &info : m_texinfo) {
+		if(info.data_ofs > hdr.texdata.size || info.size() > hdr.texdata.size - info.data_ofs) {
+			return false;
+		}
+		m_texdata.emplace_back(map, base + hdr.texdata.ofs + info.data_ofs);
+	}
 
-	fclose(fp);
 	return true;
 }
 
+// writes a temporary next to filename and renames it over filename once
+// it is on disk, a crash leaves either the old or the new file
 bool l2d::file::save(const char *filename) const
 {
-	FILE *fp = fopen(filename, "wb");
+	std::string tmp = filename;
+	tmp += ".tmp";
+
+	FILE *fp = fopen(tmp.c_str(), "wb");
 	if(fp == nullptr) {
 		return false;
 	}
 
-	header hdr;
+	header hdr = {};
 	hdr.magic[0] = 'L';
 	hdr.magic[1] = '2';
+	hdr.version = VERSION;
 
-	hdr.actions.ofs = sizeof(header);
+	hdr.actions.ofs = align(sizeof(header));
 	hdr.actions.size = m_actiondata.size();
 
-	hdr.texinfo.ofs = hdr.actions.ofs + hdr.actions.size;
+	hdr.texinfo.ofs = align(hdr.actions.ofs + hdr.actions.size);
 	hdr.texinfo.size = m_texinfo.size() * sizeof(texinfo);
 
-	hdr.texdata.ofs = hdr.texinfo.ofs + hdr.texinfo.size;
-	hdr.texdata.size = m_texdata.size();
+	hdr.texdata.ofs = align(hdr.texinfo.ofs + hdr.texinfo.size);
+	hdr.texdata.size = 0;
+	if(!m_texinfo.empty()) {
+		hdr.texdata.size = m_texinfo.back().data_ofs + m_texinfo.back().size();
+	}
 
-	hdr.strings.ofs = hdr.texdata.ofs + hdr.texdata.size;
+	hdr.strings.ofs = align(hdr.texdata.ofs + hdr.texdata.size);
 	hdr.strings.size = m_strings.size();
 
-	fseek(fp, 0, SEEK_SET);
-	fwrite(&hdr, sizeof(header), 1, fp);
-
-	fseek(fp, hdr.actions.ofs, SEEK_SET);
-	fwrite(m_actiondata.data(), hdr.actions.size, 1, fp);
-
-	fseek(fp, hdr.texinfo.ofs, SEEK_SET);
-	fwrite(m_texinfo.data(), hdr.texinfo.size, 1, fp);
+	// write the lumps in order, zero filling up to the next offset
+	static const uint8_t zeros[ALIGN] = {};
+	uint32_t ofs = 0;
+	auto put = [&](uint32_t at, const void *data, size_t size) {
+		bool ok = fwrite(zeros, 1, at - ofs, fp) == at - ofs;
+		ok &= fwrite(data, 1, size, fp) == size;
+		ofs = at + size;
+		return ok;
+	};
+
+	bool ok = put(0, &hdr, sizeof(header));
+	ok &= put(hdr.actions.ofs, m_actiondata.data(), hdr.actions.size);
+	ok &= put(hdr.texinfo.ofs, m_texinfo.data(), hdr.texinfo.size);
+	for(size_t i = 0; i < m_texinfo.size(); i++) {
+		ok &= put(hdr.texdata.ofs + m_texinfo[i].data_ofs, m_texdata[i].get(), m_texinfo[i].size());
+	}
+	ok &= put(hdr.strings.ofs, m_strings.data(), hdr.strings.size);
+	ok &= fflush(fp) == 0;
+
+#ifdef _WIN32
+	ok &= _commit(_fileno(fp)) == 0;
+#else
+	ok &= fsync(fileno(fp)) == 0;
+#endif
+	fclose(fp);
 
-	fseek(fp, hdr.texdata.ofs, SEEK_SET);
-	fwrite(m_texdata.data(), hdr.texdata.size, 1, fp);
+	std::error_code ec;
+	if(ok) {
+		std::filesystem::rename(tmp, filename, ec);
+	}
 
-	fseek(fp, hdr.strings.ofs, SEEK_SET);
-	fwrite(m_strings.data(), hdr.strings.size, 1, fp);
+	if(!ok || ec) {
+		std::filesystem::remove(tmp, ec);
+		return false;
+	}
 
 	return true;
 }
 
+// snapshots the editor, the pixels are shared with its textures
 bool l2d::file::load(const l2d::editor &edit)
 {
-	/*
 	m_texinfo.clear();
 	m_texdata.clear();
 	m_strings.clear();
 
-	for(const gl::texture &texture : edit.textures()) {
+	uint32_t data_ofs = 0;
+	for(const gl::texture &texture : edit.m_textures) {
 		texinfo &info = m_texinfo.emplace_back();
-		texture.serialize(info, m_texdata, m_strings);
+		info.name_ofs = m_strings.size();
+		info.name_size = texture.name().size();
+		m_strings.insert(m_strings.end(), texture.name().begin(), texture.name().end());
+
+		info.width = texture.width();
+		info.height = texture.height();
+		info.pixelwidth = texture.pixelwidth();
+		info.data_ofs = align(data_ofs);
+		data_ofs = info.data_ofs + info.size();
+
+		m_texdata.push_back(texture.shared());
 	}
 
-	//const ActList &actions = edit->GetActList();
-	//m_actiondata.resize(actions.BinSize());
-	//actions.Seralize(m_actiondata, m_strings);
-	*/
+	actions acts;
+	acts.stamp = edit.m_stamp;
+	acts.history = edit.m_history;
+	acts.indices = edit.m_indices.size();
+	acts.rects = edit.m_rects.size();
+	acts.lines = edit.m_lines.size();
+	acts.moves = edit.m_moves.size();
+	acts.scales = edit.m_scales.size();
+	acts.textures = edit.m_acttextures.size();
+	acts.layers = edit.m_actlayers.size();
+
+	m_actiondata.resize(sizeof(actions));
+	memcpy(m_actiondata.data(), &acts, sizeof(actions));
+
+	putarray(m_actiondata, edit.m_indices);
+	putarray(m_actiondata, edit.m_rects);
+	putarray(m_actiondata, edit.m_lines);
+	putarray(m_actiondata, edit.m_moves);
+	putarray(m_actiondata, edit.m_scales);
+	putarray(m_actiondata, edit.m_acttextures);
+	putarray(m_actiondata, edit.m_actlayers);
+
 	return true;
 }
 
 
 bool l2d::file::save(l2d::editor &edit) const
 {
-	/*
-	std::vector<gl::texture> textures = edit.textures();
+	actions acts;
+	if(m_actiondata.size() < sizeof(actions)) {
+		return false;
+	}
 
-	for(const texinfo &info : m_texinfo) {
-		size_t data_size = info.size();
-		// ~wxBitMapData() will delete data in GLTexture::Load!!!
-		uint8_t *data = new uint8_t[data_size];
+	memcpy(&acts, m_actiondata.data(), sizeof(actions));
+
+	size_t ofs = sizeof(actions);
+	if(!getarray(m_actiondata, ofs, acts.indices, edit.m_indices) ||
+	   !getarray(m_actiondata, ofs, acts.rects, edit.m_rects) ||
+	   !getarray(m_actiondata, ofs, acts.lines, edit.m_lines) ||
+	   !getarray(m_actiondata, ofs, acts.moves, edit.m_moves) ||
+	   !getarray(m_actiondata, ofs, acts.scales, edit.m_scales) ||
+	   !getarray(m_actiondata, ofs, acts.textures, edit.m_acttextures) ||
+	   !getarray(m_actiondata, ofs, acts.layers, edit.m_actlayers)) {
+		return false;
+	}
+
+	edit.m_stamp = acts.stamp;
+	edit.m_history = std::min<uint32_t>(acts.history, acts.indices);
+
+	for(size_t i = 0; i < m_texinfo.size(); i++) {
+		const texinfo &info = m_texinfo[i];
+		if(info.name_ofs + info.name_size > m_strings.size()) {
+			return false;
+		}
+
+		std::string name(m_strings.begin() + info.name_ofs,
+		                 m_strings.begin() + info.name_ofs + info.name_size);
+
+		gl::texture &texture = edit.m_textures.emplace_back();
+		texture.load(info.width, info.height, info.pixelwidth, name.c_str(), m_texdata[i]);
+	}
+
+	return true;
+}
+
+
+void l2d::journal::open(const char *filename, uint32_t history, uint32_t stamp)
+{
+	m_path = filename;
+	m_path += ".jnl";
+	m_buffer.clear();
+	m_last = -1;
+	m_history = history;
+	m_written = history;
+	m_stamp = stamp;
+	m_based = false;
+}
 
-		char *name = new char[info.name_size];
 
-		memcpy(data, m_texdata.data() + info.data_ofs, data_size);
-		memcpy(name, m_strings.data() + info.name_ofs, info.name_size);
+// open for a file the journal doesn't belong to yet, whatever was left
+// at its path is about some other file
+void l2d::journal::create(const char *filename, uint32_t history, uint32_t stamp)
+{
+	open(filename, history, stamp);
 
-		gl::texture texture;
-		texture.load(info.width, info.height, info.pixelwidth, name, data);
+	std::error_code ec;
+	std::filesystem::remove(m_path, ec);
+}
 
-		textures.push_back(texture);
 
-		delete[] name;
+bool l2d::journal::read(std::vector<uint8_t> &data) const
+{
+	FILE *fp = fopen(m_path.c_str(), "rb");
+	if(fp == nullptr) {
+		return false;
 	}
 
-	//ActList &actions = edit->GetActList();
-	//actions.Deserialize(m_actiondata, m_strings);
+	fseek(fp, 0, SEEK_END);
+	long size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
 
-	*/
+	data.resize(size > 0 ? size : 0);
+	size_t n = fread(data.data(), 1, data.size(), fp);
+	data.resize(n);
+
+	fclose(fp);
 	return true;
 }
+
+
+// moves an unreadable journal out of the way, kept as <file>.jnl.bad for
+// recovering by hand. the next flush starts a new one.
+void l2d::journal::discard()
+{
+	std::error_code ec;
+	std::filesystem::rename(m_path, m_path + ".bad", ec);
+	m_based = false;
+}
+
+
+// the changes from here on apply to the file saved with stamp
+void l2d::journal::rebase(uint32_t stamp)
+{
+	flush(true);
+	m_stamp = stamp;
+	m_based = false;
+}
+
+
+// the file stamped stamp is on disk, everything in the journal before its
+// BASE record is in the file too. drop that part, or the whole journal if
+// it holds nothing newer.
+void l2d::journal::saved(uint32_t stamp)
+{
+	if(stamp != m_stamp || m_path.empty()) {
+		return;
+	}
+
+	std::error_code ec;
+	if(!m_based) {
+		std::filesystem::remove(m_path, ec);
+		return;
+	}
+
+	std::vector<uint8_t> data;
+	if(!read(data)) {
+		return;
+	}
+
+	record rec;
+	const uint8_t *payload;
+	size_t from = 0;
+	bool found = false;
+	for(size_t ofs = 0; !found && (ofs = next(data, from, rec, payload)) != 0; ) {
+		found = rec.kind == BASE && rec.position == stamp;
+		if(!found) {
+			from = ofs;
+		}
+	}
+
+	// not there or already first
+	if(!found || from == 0) {
+		return;
+	}
+
+	// same dance as file::save, a crash leaves either journal whole
+	std::string tmp = m_path + ".tmp";
+	FILE *fp = fopen(tmp.c_str(), "wb");
+	if(fp == nullptr) {
+		return;
+	}
+
+	bool ok = fwrite(data.data() + from, 1, data.size() - from, fp) == data.size() - from;
+	ok &= fflush(fp) == 0;
+#ifdef _WIN32
+	ok &= _commit(_fileno(fp)) == 0;
+#else
+	ok &= fsync(fileno(fp)) == 0;
+#endif
+	fclose(fp);
+
+	if(ok) {
+		std::filesystem::rename(tmp, m_path, ec);
+	}
+
+	if(!ok || ec) {
+		std::filesystem::remove(tmp, ec);
+	}
+}
+
+
+void l2d::journal::append(kind kind, uint32_t position, const void *payload, size_t size)
+{
+	// a drag keeps rewriting the same index, only its last state is kept
+	if(kind == SET && m_last != -1) {
+		record last;
+		memcpy(&last, m_buffer.data() + m_last, sizeof(record));
+		if(last.kind == SET && last.position == position) {
+			m_buffer.resize(m_last);
+		}
+	}
+
+	if(!pending()) {
+		m_first = clock::now();
+	}
+
+	record rec;
+	rec.kind = kind;
+	rec.position = position;
+	rec.size = size;
+
+	m_last = m_buffer.size();
+	m_buffer.resize(m_last + sizeof(record) + size);
+	memcpy(m_buffer.data() + m_last, &rec, sizeof(record));
+	if(size != 0) {
+		memcpy(m_buffer.data() + m_last + sizeof(record), payload, size);
+	}
+}
+
+
+void l2d::journal::history(uint32_t history)
+{
+	if(!pending()) {
+		m_first = clock::now();
+	}
+
+	m_history = history;
+}
+
+
+// writes the buffered records once enough of them piled up or aged
+bool l2d::journal::flush(bool force)
+{
+	if(m_path.empty() || !pending()) {
+		return true;
+	}
+
+	if(!force && m_buffer.size() < FLUSH_BYTES &&
+	   clock::now() - m_first < std::chrono::milliseconds(FLUSH_MS)) {
+		return true;
+	}
+
+	if(m_history != m_written) {
+		append(HISTORY, m_history, nullptr, 0);
+	}
+
+	FILE *fp = fopen(m_path.c_str(), "ab");
+	if(fp == nullptr) {
+		return false;
+	}
+
+	bool ok = true;
+	if(!m_based) {
+		record base;
+		base.kind = BASE;
+		base.position = m_stamp;
+		base.size = 0;
+		ok = fwrite(&base, sizeof(record), 1, fp) == 1;
+	}
+
+	ok &= fwrite(m_buffer.data(), 1, m_buffer.size(), fp) == m_buffer.size();
+	fclose(fp);
+
+	if(!ok) {
+		return false;
+	}
+
+	m_based = true;
+	m_buffer.clear();
+	m_last = -1;
+	m_written = m_history;
+	return true;
+}
+
+
+// offset of the record after the one at ofs, 0 at the end or a torn tail
+size_t l2d::journal::next(const std::vector<uint8_t> &data, size_t ofs, record &rec, const uint8_t *&payload)
+{
+	if(ofs + sizeof(record) > data.size()) {
+		return 0;
+	}
+
+	memcpy(&rec, data.data() + ofs, sizeof(record));
+	ofs += sizeof(record);
+
+	if(ofs + rec.size > data.size()) {
+		return 0;
+	}
+
+	payload = data.data() + ofs;
+	return ofs + rec.size;
+}
@@ -3,24 +3,36 @@
 #define _L2DFILE_HPP
 
 #include <vector>
+#include <string>
+#include <chrono>
+#include <memory>
 #include <cstdint>
 
 namespace l2d {
-class editor;
-/* stripped down version of GLTexture */
+struct editor;
+/* stripped down version of GLTexture. stored as is, keep it packed and
+   the padding explicit. */
 struct texinfo {
 	uint32_t name_ofs;
 	uint32_t name_size;
 	uint32_t width;
 	uint32_t height;
 	uint8_t  pixelwidth;
+	uint8_t  pad[3];
+	// from the start of the texdata lump
 	uint32_t data_ofs;
 	inline uint32_t size() const
 	{
 		return width * height * pixelwidth;
 	}
 };
+/* .l2d file. load() maps the file and the textures made from it keep
+   pointing into the mapping, they are only paged in when uploaded. */
 struct file {
+	static constexpr uint8_t VERSION = 2;
+	// lumps and the pixels of every texture start at this alignment
+	static constexpr uint32_t ALIGN = 16;
+
 	bool load(const char *filename);
 	bool save(const char *filename) const;
 	bool load(const l2d::editor &edit);
@@ -28,9 +40,65 @@ struct file {
 private:
 	std::vector<texinfo> m_texinfo;
 	std::vector<uint8_t> m_actiondata;
-	std::vector<uint8_t> m_texdata;
+	// pixels of each texinfo, in the texdata lump
+	std::vector<std::shared_ptr<const uint8_t[]>> m_texdata;
 	std::vector<uint8_t> m_strings;
 };
+
+/* append-only log of the history changes since the file was last saved,
+   kept next to it as <file>.jnl. records are buffered and written out in
+   batches, replaying them over the file gives the unsaved history. every
+   save gets a new stamp, a BASE record marks where the changes on top of
+   the file with that stamp start. */
+struct journal {
+	static constexpr size_t FLUSH_BYTES = 64 * 1024;
+	static constexpr int FLUSH_MS = 500;
+
+	enum kind : uint32_t {
+		// truncate the history to position, append the index in the payload
+		SET,
+		// truncate the history to position
+		TRUNCATE,
+		// history position after the batch
+		HISTORY,
+		// texture at position, texinfo followed by its name and pixels
+		TEXTURE,
+		// the records after this one apply to the file stamped position
+		BASE
+	};
+	struct record {
+		uint32_t kind;
+		uint32_t position;
+		uint32_t size;
+	};
+
+	void open(const char *filename, uint32_t history, uint32_t stamp);
+	void create(const char *filename, uint32_t history, uint32_t stamp);
+	bool read(std::vector<uint8_t> &data) const;
+	void discard();
+	void rebase(uint32_t stamp);
+	void saved(uint32_t stamp);
+	void append(kind kind, uint32_t position, const void *payload, size_t size);
+	void history(uint32_t history);
+	bool pending() const { return !m_buffer.empty() || m_history != m_written; }
+	bool flush(bool force);
+	static size_t next(const std::vector<uint8_t> &data, size_t ofs, record &rec, const uint8_t *&payload);
+private:
+	using clock = std::chrono::steady_clock;
+
+	std::string m_path;
+	std::vector<uint8_t> m_buffer;
+	// offset of the last buffered record, -1 when there is none
+	size_t m_last = -1;
+	// oldest unwritten change
+	clock::time_point m_first;
+	uint32_t m_history = 0;
+	// history position the file on disk ends with
+	uint32_t m_written = 0;
+	uint32_t m_stamp = 0;
+	// whether the BASE record of m_stamp was written
+	bool m_based = false;
+};
 }
 
 #endif
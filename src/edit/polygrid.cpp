@@ -0,0 +1,117 @@
+#include <algorithm>
+
+#include "src/edit/polygrid.hpp"
+
+
+static void unlist(std::vector<size_t> &list, size_t poly)
+{
+	auto it = std::find(list.begin(), list.end(), poly);
+	if(it != list.end()) {
+		*it = list.back();
+		list.pop_back();
+	}
+}
+
+
+bool l2d::polygrid::oversize(const irect2d &aabb)
+{
+	glm::i32vec2 mins = cell(aabb.mins);
+	glm::i32vec2 maxs = cell(aabb.maxs);
+	int64_t w = int64_t(maxs.x) - mins.x + 1;
+	int64_t h = int64_t(maxs.y) - mins.y + 1;
+	return w * h > MAX_CELLS;
+}
+
+
+uint32_t l2d::polygrid::nextstamp() const
+{
+	if(++m_stamp == 0) {
+		// wrapped, forget every old stamp
+		for(const entry &e : m_entries) {
+			e.stamp = 0;
+		}
+		m_stamp = 1;
+	}
+
+	return m_stamp;
+}
+
+
+void l2d::polygrid::insert(size_t poly, const irect2d &aabb)
+{
+	if(poly >= m_entries.size()) {
+		m_entries.resize(poly + 1);
+	}
+
+	entry &e = m_entries[poly];
+	if(e.listed) {
+		if(e.aabb.mins == aabb.mins && e.aabb.maxs == aabb.maxs) {
+			return;
+		}
+		remove(poly);
+	}
+
+	e.aabb = aabb;
+	e.listed = true;
+	e.oversize = oversize(aabb);
+
+	if(e.oversize) {
+		m_oversize.push_back(poly);
+		return;
+	}
+
+	glm::i32vec2 mins = cell(aabb.mins);
+	glm::i32vec2 maxs = cell(aabb.maxs);
+	for(int y = mins.y; y <= maxs.y; y++) {
+		for(int x = mins.x; x <= maxs.x; x++) {
+			m_cells[key(x, y)].push_back(poly);
+		}
+	}
+}
+
+
+void l2d::polygrid::remove(size_t poly)
+{
+	if(!contains(poly)) {
+		return;
+	}
+
+	entry &e = m_entries[poly];
+	e.listed = false;
+
+	if(e.oversize) {
+		unlist(m_oversize, poly);
+		return;
+	}
+
+	glm::i32vec2 mins = cell(e.aabb.mins);
+	glm::i32vec2 maxs = cell(e.aabb.maxs);
+	for(int y = mins.y; y <= maxs.y; y++) {
+		for(int x = mins.x; x <= maxs.x; x++) {
+			auto it = m_cells.find(key(x, y));
+			if(it == m_cells.end()) {
+				continue;
+			}
+			unlist(it->second, poly);
+			if(it->second.empty()) {
+				m_cells.erase(it);
+			}
+		}
+	}
+}
+
+
+void l2d::polygrid::update(size_t poly, const irect2d &aabb)
+{
+	if(contains(poly)) {
+		insert(poly, aabb);
+	}
+}
+
+
+void l2d::polygrid::clear()
+{
+	m_cells.clear();
+	m_oversize.clear();
+	m_entries.clear();
+}
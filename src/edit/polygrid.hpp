@@ -0,0 +1,97 @@
+#ifndef _POLYGRID_HPP
+#define _POLYGRID_HPP
+
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+
+#include "src/geometry.hpp"
+
+namespace l2d {
+/* uniform grid over the aabbs of one layer's polys. each poly is listed
+   in every cell its aabb touches, polys spanning too many cells go into
+   a list that every query visits. queries only return candidates, the
+   caller still does the exact test. */
+struct polygrid {
+	constexpr static int CELL_SHIFT = 4;
+	constexpr static int MAX_CELLS = 64;
+
+	// insert and update are the same, a poly is only ever listed once
+	void insert(size_t poly, const irect2d &aabb);
+	void remove(size_t poly);
+	void update(size_t poly, const irect2d &aabb);
+	bool contains(size_t poly) const
+	{
+		return poly < m_entries.size() && m_entries[poly].listed;
+	}
+	void clear();
+
+	// calls fn(poly) once for every poly whose aabb touches r, stops
+	// early and returns true as soon as fn does.
+	template<typename F>
+	bool query(const irect2d &r, F &&fn) const
+	{
+		uint32_t stamp = nextstamp();
+
+		for(size_t poly : m_oversize) {
+			if(visit(poly, r, stamp) && fn(poly)) {
+				return true;
+			}
+		}
+
+		glm::i32vec2 mins = cell(r.mins);
+		glm::i32vec2 maxs = cell(r.maxs);
+		for(int y = mins.y; y <= maxs.y; y++) {
+			for(int x = mins.x; x <= maxs.x; x++) {
+				auto it = m_cells.find(key(x, y));
+				if(it == m_cells.end()) {
+					continue;
+				}
+				for(size_t poly : it->second) {
+					if(visit(poly, r, stamp) && fn(poly)) {
+						return true;
+					}
+				}
+			}
+		}
+
+		return false;
+	}
+private:
+	struct entry {
+		irect2d aabb;
+		mutable uint32_t stamp = 0;
+		bool listed = false;
+		bool oversize = false;
+	};
+
+	static glm::i32vec2 cell(const glm::i32vec2 &p)
+	{
+		return { p.x >> CELL_SHIFT, p.y >> CELL_SHIFT };
+	}
+	static uint64_t key(int x, int y)
+	{
+		return (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(y);
+	}
+	static bool oversize(const irect2d &aabb);
+	uint32_t nextstamp() const;
+	// first visit of poly in this query and its aabb touches r
+	bool visit(size_t poly, const irect2d &r, uint32_t stamp) const
+	{
+		const entry &e = m_entries[poly];
+		if(e.stamp == stamp) {
+			return false;
+		}
+		e.stamp = stamp;
+		return e.aabb.mins.x <= r.maxs.x && r.mins.x <= e.aabb.maxs.x &&
+		       e.aabb.mins.y <= r.maxs.y && r.mins.y <= e.aabb.maxs.y;
+	}
+
+	std::unordered_map<uint64_t, std::vector<size_t>> m_cells;
+	std::vector<size_t> m_oversize;
+	std::vector<entry> m_entries;
+	mutable uint32_t m_stamp = 0;
+};
+}
+
+#endif
@@ -1,7 +1,14 @@
 #include <numeric>
 #include <cassert>
+#include <limits>
+#include <iterator>
 #include <glm/glm.hpp>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define L2D_SSE2
+#include <emmintrin.h>
+#endif
+
 #include "src/edit/editorcontext.hpp"
 #include "src/gl/glcontext.hpp"
 #include "src/geometry.hpp"
@@ -74,9 +81,9 @@ void iline2d::scale(const glm::i32vec2 &origin, const glm::i32vec2 &numer, const
 }
 
 
-void iline2d::clip(const std::vector<glm::vec2> &points, std::vector<glm::vec2> &out) {
-
-	size_t npoints = points.size();
+size_t iline2d::clip(const glm::vec2 points[], size_t npoints, glm::vec2 out[]) const
+{
+	size_t n = 0;
 	for(size_t i = 0; i < npoints; i++) {
 		glm::vec2 a = points[i];
 		glm::vec2 b = points[(i + 1) % npoints];
@@ -86,7 +93,7 @@ void iline2d::clip(const std::vector<glm::vec2> &points, std::vector<glm::vec2>
 
 		/* only "forward" side */
 		if(da >= 0) {
-			out.push_back(a);
+			out[n++] = a;
 		}
 
 		if(da * db < 0) {
@@ -94,9 +101,11 @@ void iline2d::clip(const std::vector<glm::vec2> &points, std::vector<glm::vec2>
 			isect.x = a.x * db - b.x * da;
 			isect.y = a.y * db - b.y * da;
 			isect /= db - da;
-			out.push_back(isect);
+			out[n++] = isect;
 		}
 	}
+
+	return n;
 }
 
 
@@ -118,6 +127,85 @@ bool iline2d::operator==(const iline2d &other) const
 }
 
 
+void planerange(const iline2d &plane, const glm::vec2 pts[], size_t npts, float &lo, float &hi)
+{
+	float a = static_cast<float>(plane.a);
+	float b = static_cast<float>(plane.b);
+	float c = static_cast<float>(plane.c);
+
+	lo = std::numeric_limits<float>::infinity();
+	hi = -std::numeric_limits<float>::infinity();
+
+	size_t i = 0;
+#ifdef L2D_SSE2
+	static_assert(sizeof(glm::vec2) == 2 * sizeof(float));
+
+	if(npts >= 4) {
+		__m128 va = _mm_set1_ps(a);
+		__m128 vb = _mm_set1_ps(b);
+		__m128 vc = _mm_set1_ps(c);
+		__m128 vlo = _mm_set1_ps(lo);
+		__m128 vhi = _mm_set1_ps(hi);
+
+		for(; i + 4 <= npts; i += 4) {
+			// x0 y0 x1 y1, x2 y2 x3 y3 -> x0 x1 x2 x3, y0 y1 y2 y3
+			__m128 p01 = _mm_loadu_ps(&pts[i].x);
+			__m128 p23 = _mm_loadu_ps(&pts[i + 2].x);
+			__m128 xs = _mm_shuffle_ps(p01, p23, _MM_SHUFFLE(2, 0, 2, 0));
+			__m128 ys = _mm_shuffle_ps(p01, p23, _MM_SHUFFLE(3, 1, 3, 1));
+
+			__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(va, xs), _mm_mul_ps(vb, ys)), vc);
+			vlo = _mm_min_ps(vlo, d);
+			vhi = _mm_max_ps(vhi, d);
+		}
+
+		float l[4], h[4];
+		_mm_storeu_ps(l, vlo);
+		_mm_storeu_ps(h, vhi);
+		lo = std::min(std::min(l[0], l[1]), std::min(l[2], l[3]));
+		hi = std::max(std::max(h[0], h[1]), std::max(h[2], h[3]));
+	}
+#endif
+
+	for(; i < npts; i++) {
+		float d = a * pts[i].x + b * pts[i].y + c;
+		lo = std::min(lo, d);
+		hi = std::max(hi, d);
+	}
+}
+
+
+bool infrontofall(const iline2d planes[], size_t nplanes, const glm::vec2 &pt)
+{
+	size_t i = 0;
+#ifdef L2D_SSE2
+	__m128 x = _mm_set1_ps(pt.x);
+	__m128 y = _mm_set1_ps(pt.y);
+	__m128 zero = _mm_setzero_ps();
+
+	for(; i + 4 <= nplanes; i += 4) {
+		const iline2d *p = planes + i;
+		__m128 a = _mm_cvtepi32_ps(_mm_setr_epi32(p[0].a, p[1].a, p[2].a, p[3].a));
+		__m128 b = _mm_cvtepi32_ps(_mm_setr_epi32(p[0].b, p[1].b, p[2].b, p[3].b));
+		__m128 c = _mm_cvtepi32_ps(_mm_setr_epi32(p[0].c, p[1].c, p[2].c, p[3].c));
+
+		__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, x), _mm_mul_ps(b, y)), c);
+		if(_mm_movemask_ps(_mm_cmple_ps(d, zero)) != 0) {
+			return false;
+		}
+	}
+#endif
+
+	for(; i < nplanes; i++) {
+		if(planes[i].distnumer(pt) <= 0.0f) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
 poly2d::poly2d(const irect2d &rect)
 {
 	m_aabb = rect;
@@ -165,12 +253,9 @@ void poly2d::offset(const glm::i32vec2 &delta)
 
 bool poly2d::allptsbehind(const iline2d &plane, const glm::vec2 points[], size_t npoints)
 {
-	for(size_t i = 0; i < npoints; i++) {
-		if(plane.distnumer(points[i]) > 0.0) {
-			return false;
-		}
-	}
-	return true;
+	float lo, hi;
+	planerange(plane, points, npoints, lo, hi);
+	return !(hi > 0.0f);
 }
 
 bool poly2d::allptsbehind(const iline2d &plane, const glm::i32vec2 points[], size_t npoints)
@@ -242,49 +327,380 @@ bool poly2d::contains(const glm::vec2 &pt) const
 		return false;
 	}
 
-	for(const iline2d &plane : m_lines) {
-		if(plane.distnumer(pt) <= 0.0) {
+	return infrontofall(m_lines.data(), m_lines.size(), pt);
+}
+
+
+bool poly2d::intersects(const poly2d &other) const
+{
+	sephint hint;
+	return intersects(other, hint);
+}
+
+
+bool poly2d::intersects(const poly2d &other, sephint &hint) const
+{
+	if(hint.kind != sephint::NONE && separates(other, hint)) {
+		return false;
+	}
+
+	if(!m_aabb.intersects(other.m_aabb)) {
+		hint.kind = sephint::AABB;
+		for(hint.index = 0; hint.index < 4; hint.index++) {
+			if(separates(other, hint)) {
+				break;
+			}
+		}
+		return false;
+	}
+
+	for(size_t i = 0; i < other.m_lines.size(); i++) {
+		if(allptsbehind(other.m_lines[i])) {
+			hint.kind = sephint::THEIRS;
+			hint.index = i;
 			return false;
 		}
 	}
 
+	for(size_t i = 0; i < m_lines.size(); i++) {
+		if(other.allptsbehind(m_lines[i])) {
+			hint.kind = sephint::OURS;
+			hint.index = i;
+			return false;
+		}
+	}
+
+	hint.kind = sephint::NONE;
 	return true;
 }
 
 
-bool poly2d::intersects(const poly2d &other) const
+bool poly2d::separates(const poly2d &other, const sephint &hint) const
 {
-	if(!m_aabb.intersects(other.m_aabb)) {
+	const irect2d &a = m_aabb;
+	const irect2d &b = other.m_aabb;
+
+	switch(hint.kind) {
+	case sephint::AABB:
+		switch(hint.index) {
+		case 0: return a.maxs.x <= b.mins.x;
+		case 1: return b.maxs.x <= a.mins.x;
+		case 2: return a.maxs.y <= b.mins.y;
+		case 3: return b.maxs.y <= a.mins.y;
+		default: return false;
+		}
+	case sephint::OURS:
+		return hint.index < m_lines.size() && other.allptsbehind(m_lines[hint.index]);
+	case sephint::THEIRS:
+		return hint.index < other.m_lines.size() && allptsbehind(other.m_lines[hint.index]);
+	default:
 		return false;
 	}
+}
 
-	for(const iline2d &plane : other.m_lines) {
-		if(allptsbehind(plane)) {
+
+// true if the axis in hint alone keeps this poly, offset by ofs, clear of
+// other for the whole of d. uses the same terms as sweep below.
+bool poly2d::sweepclear(const poly2d &other, const glm::vec2 &ofs, const glm::vec2 &d, const sephint &hint) const
+{
+	float m, k, lo, hi;
+
+	switch(hint.kind) {
+	case sephint::AABB:
+		switch(hint.index) {
+		case 0: m = m_aabb.maxs.x + ofs.x - other.m_aabb.mins.x; k = d.x; break;
+		case 1: m = other.m_aabb.maxs.x - m_aabb.mins.x - ofs.x; k = -d.x; break;
+		case 2: m = m_aabb.maxs.y + ofs.y - other.m_aabb.mins.y; k = d.y; break;
+		case 3: m = other.m_aabb.maxs.y - m_aabb.mins.y - ofs.y; k = -d.y; break;
+		default: return false;
+		}
+		break;
+	case sephint::OURS: {
+		if(hint.index >= m_lines.size()) {
 			return false;
 		}
+		const iline2d &plane = m_lines[hint.index];
+		glm::vec2 n = { static_cast<float>(plane.a), static_cast<float>(plane.b) };
+		planerange(plane, other.m_points.data(), other.m_points.size(), lo, hi);
+		m = hi - glm::dot(n, ofs);
+		k = -glm::dot(n, d);
+		break;
 	}
+	case sephint::THEIRS: {
+		if(hint.index >= other.m_lines.size()) {
+			return false;
+		}
+		const iline2d &plane = other.m_lines[hint.index];
+		glm::vec2 n = { static_cast<float>(plane.a), static_cast<float>(plane.b) };
+		planerange(plane, m_points.data(), m_points.size(), lo, hi);
+		m = hi + glm::dot(n, ofs);
+		k = glm::dot(n, d);
+		break;
+	}
+	default:
+		return false;
+	}
+
+	// linear in t, so separated at both ends means separated throughout
+	return m <= 0.0f && m + k <= 0.0f;
+}
+
 
+/* how many whole units of steps, taken along axis from ofs, this poly can
+   move before it intersects other. every plane of either poly and every
+   aabb side is a separating axis, each separates for s on one side of
+   where it is crossed. the polys are clear for as long as [0, s] stays
+   covered by those. each crossing is one division of whole numbers, so
+   flooring it never overshoots and still stops flush. hint is tried on
+   its own first, while dragging it usually covers the whole move, and is
+   left on the axis that separates the pair where the move stops. */
+int poly2d::sweep(const poly2d &other, const glm::i32vec2 &ofs, int axis, int steps, sephint &hint) const
+{
+	constexpr double INF = std::numeric_limits<double>::infinity();
+
+	glm::i32vec2 d = { 0, 0 };
+	d[axis] = steps;
+	if(steps == 0 || sweepclear(other, ofs, d, hint)) {
+		return steps;
+	}
+
+	// one step
+	glm::dvec2 e = { 0.0, 0.0 };
+	e[axis] = steps < 0 ? -1.0 : 1.0;
+	const glm::dvec2 o = ofs;
+
+	// separated while s <= until, and again from s >= after
+	double until = -INF;
+	double after = INF;
+	bool always = false;
+	sephint untilhint, afterhint, alwayshint;
+
+	// an axis separates while m + s * k <= 0
+	auto test = [&](double m, double k, sephint::axis kind, uint32_t index) {
+		if(k == 0.0) {
+			if(!always && m <= 0.0) {
+				always = true;
+				alwayshint = { kind, index };
+			}
+		} else if(k > 0.0) {
+			if(-m / k > until) {
+				until = -m / k;
+				untilhint = { kind, index };
+			}
+		} else if(-m / k < after) {
+			after = -m / k;
+			afterhint = { kind, index };
+		}
+	};
+
+	test(m_aabb.maxs.x + o.x - other.m_aabb.mins.x, e.x, sephint::AABB, 0);
+	test(other.m_aabb.maxs.x - m_aabb.mins.x - o.x, -e.x, sephint::AABB, 1);
+	test(m_aabb.maxs.y + o.y - other.m_aabb.mins.y, e.y, sephint::AABB, 2);
+	test(other.m_aabb.maxs.y - m_aabb.mins.y - o.y, -e.y, sephint::AABB, 3);
+
+	float lo, hi;
+	for(uint32_t i = 0; i < m_lines.size(); i++) {
+		const iline2d &plane = m_lines[i];
+		glm::dvec2 n = { static_cast<double>(plane.a), static_cast<double>(plane.b) };
+		planerange(plane, other.m_points.data(), other.m_points.size(), lo, hi);
+		test(hi - glm::dot(n, o), -glm::dot(n, e), sephint::OURS, i);
+	}
+
+	for(uint32_t i = 0; i < other.m_lines.size(); i++) {
+		const iline2d &plane = other.m_lines[i];
+		glm::dvec2 n = { static_cast<double>(plane.a), static_cast<double>(plane.b) };
+		planerange(plane, m_points.data(), m_points.size(), lo, hi);
+		test(hi + glm::dot(n, o), glm::dot(n, e), sephint::THEIRS, i);
+	}
+
+	if(always) {
+		hint = alwayshint;
+		return steps;
+	}
+
+	const double n = std::abs(steps);
+	if(after <= std::max(until, 0.0)) {
+		hint = until >= n ? untilhint : afterhint;
+		return steps;
+	}
+
+	if(until < 0.0) {
+		return 0;
+	}
+
+	hint = untilhint;
+	int s = static_cast<int>(std::min(std::floor(until), n));
+	return steps < 0 ? -s : s;
+}
+
+
+/* extents from origin, in whole units, the side of this poly base units
+   away from origin along axis can be dragged to before the poly
+   intersects other. like sweep, each plane and aabb side is a separating
+   axis, but here each one separates for an interval of extents e. the
+   poly is clear on the part of their union connected to e = base. the
+   ends are single divisions of whole numbers, so rounding them inwards
+   is exact. */
+void poly2d::scalerange(const poly2d &other, const glm::i32vec2 &origin, int axis, int base, int &lo, int &hi) const
+{
+	constexpr double INF = std::numeric_limits<double>::infinity();
+	const int perp = 1 - axis;
+	const glm::dvec2 o = origin;
+	const double b = base;
+
+	smallvec<glm::dvec2, INLINE_CAPACITY * 2 + 4> spans;
+
+	// narrows span to the e where a * base + e * k <= 0, the scale
+	// factor is e / base
+	auto halfline = [b](glm::dvec2 &span, double a, double k) {
+		a *= b;
+		if(k > 0.0) {
+			span.y = std::min(span.y, -a / k);
+		} else if(k < 0.0) {
+			span.x = std::max(span.x, -a / k);
+		} else if(a > 0.0) {
+			span = { INF, -INF };
+		}
+	};
+
+	// aabb sides, only those along axis move
+	glm::dvec2 span = { 0.0, INF };
+	halfline(span, o[axis] - other.m_aabb.mins[axis], m_aabb.maxs[axis] - o[axis]);
+	spans.push_back(span);
+	span = { 0.0, INF };
+	halfline(span, other.m_aabb.maxs[axis] - o[axis], o[axis] - m_aabb.mins[axis]);
+	spans.push_back(span);
+	span = { 0.0, INF };
+	halfline(span, m_aabb.maxs[perp] - other.m_aabb.mins[perp], 0.0);
+	spans.push_back(span);
+	span = { 0.0, INF };
+	halfline(span, other.m_aabb.maxs[perp] - m_aabb.mins[perp], 0.0);
+	spans.push_back(span);
+
+	// our planes scaled, multiplied through by the factor so they stay
+	// linear
 	for(const iline2d &plane : m_lines) {
-		if(other.allptsbehind(plane)) {
-			return false;
+		glm::dvec2 n = { static_cast<double>(plane.a), static_cast<double>(plane.b) };
+		span = { 0.0, INF };
+		for(const glm::vec2 &q : other.m_points) {
+			glm::dvec2 fixed = q;
+			fixed[axis] = o[axis];
+			halfline(span, n[axis] * (q[axis] - o[axis]), glm::dot(n, fixed) + plane.c);
 		}
+		spans.push_back(span);
 	}
 
-	return true;
+	// their planes against our scaled points
+	for(const iline2d &plane : other.m_lines) {
+		glm::dvec2 n = { static_cast<double>(plane.a), static_cast<double>(plane.b) };
+		span = { 0.0, INF };
+		for(const glm::vec2 &p : m_points) {
+			glm::dvec2 fixed = p;
+			fixed[axis] = o[axis];
+			halfline(span, glm::dot(n, fixed) + plane.c, n[axis] * (p[axis] - o[axis]));
+		}
+		spans.push_back(span);
+	}
+
+	double l = b, h = b;
+	for(bool grown = true; grown; ) {
+		grown = false;
+		for(const glm::dvec2 &s : spans) {
+			if(s.x <= h && s.y >= l && (s.x < l || s.y > h)) {
+				l = std::min(l, s.x);
+				h = std::max(h, s.y);
+				grown = true;
+			}
+		}
+	}
+
+	constexpr double LIMIT = std::numeric_limits<int>::max();
+	lo = static_cast<int>(std::ceil(l));
+	hi = static_cast<int>(std::min(std::floor(h), LIMIT));
 }
 
 
-void poly2d::fitlines()
+/* true if a single axis keeps this poly clear of other for every pair of
+   extents in [lo, hi], scaled about origin from base as in scalerange.
+   each test is linear in the scale factors or in their inverses, so one
+   that holds at the four corners of the box holds all over it. */
+bool poly2d::scaleclear(const poly2d &other, const glm::i32vec2 &origin, const glm::i32vec2 &base, const glm::i32vec2 &lo, const glm::i32vec2 &hi) const
 {
-	/* remove all planes that aren't touching any points */
-	m_lines.erase(std::remove_if(m_lines.begin(), m_lines.end(), [this](iline2d plane) {
-		constexpr float EPSILON = 0.001f;
-		for(const glm::vec2 &pt : m_points) {
-			if(plane.distnumer(pt) < EPSILON) {
+	const glm::dvec2 o = origin;
+	const glm::dvec2 b = base;
+	const glm::dvec2 corners[4] = {
+		{ lo.x, lo.y }, { hi.x, lo.y }, { lo.x, hi.y }, { hi.x, hi.y }
+	};
+
+	auto everywhere = [&](auto &&separates) {
+		for(const glm::dvec2 &e : corners) {
+			if(!separates(e)) {
 				return false;
 			}
 		}
 		return true;
+	};
+
+	// aabb sides, multiplied through by base
+	for(int axis = 0; axis < 2; axis++) {
+		double ob = o[axis] * b[axis];
+		if(everywhere([&](const glm::dvec2 &e) {
+			return ob + e[axis] * (m_aabb.maxs[axis] - o[axis]) <= other.m_aabb.mins[axis] * b[axis];
+		})) {
+			return true;
+		}
+		if(everywhere([&](const glm::dvec2 &e) {
+			return other.m_aabb.maxs[axis] * b[axis] <= ob + e[axis] * (m_aabb.mins[axis] - o[axis]);
+		})) {
+			return true;
+		}
+	}
+
+	// our planes, multiplied through by both extents
+	for(const iline2d &plane : m_lines) {
+		glm::dvec2 n = { static_cast<double>(plane.a), static_cast<double>(plane.b) };
+		double c = glm::dot(n, o) + plane.c;
+		if(everywhere([&](const glm::dvec2 &e) {
+			for(const glm::vec2 &q : other.m_points) {
+				if(n.x * b.x * (q.x - o.x) * e.y + n.y * b.y * (q.y - o.y) * e.x + c * e.x * e.y > 0.0) {
+					return false;
+				}
+			}
+			return true;
+		})) {
+			return true;
+		}
+	}
+
+	// their planes against our scaled points, multiplied through by base
+	for(const iline2d &plane : other.m_lines) {
+		glm::dvec2 n = { static_cast<double>(plane.a), static_cast<double>(plane.b) };
+		if(everywhere([&](const glm::dvec2 &e) {
+			for(const glm::vec2 &p : m_points) {
+				double x = o.x * b.x + e.x * (p.x - o.x);
+				double y = o.y * b.y + e.y * (p.y - o.y);
+				if(n.x * x * b.y + n.y * y * b.x + plane.c * b.x * b.y > 0.0) {
+					return false;
+				}
+			}
+			return true;
+		})) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+void poly2d::fitlines()
+{
+	/* remove all planes that aren't touching any points */
+	m_lines.erase(std::remove_if(m_lines.begin(), m_lines.end(), [this](const iline2d &plane) {
+		constexpr float EPSILON = 0.001f;
+		float lo, hi;
+		planerange(plane, m_points.data(), m_points.size(), lo, hi);
+		return !(lo < EPSILON);
 	}), m_lines.end());
 }
 
@@ -293,16 +709,34 @@ void poly2d::slice(iline2d plane)
 {
 	m_lines.push_back(plane);
 
-	std::vector<glm::vec2> new_points;
-	addline(plane, new_points);
+	// clipping adds at most one point
+	glm::vec2 scratch[INLINE_CAPACITY + 1];
+	static thread_local std::vector<glm::vec2> spill;
+
+	glm::vec2 *out = scratch;
+	if(m_points.size() + 1 > std::size(scratch)) {
+		spill.resize(m_points.size() + 1);
+		out = spill.data();
+	}
+
+	size_t n = plane.clip(m_points.data(), m_points.size(), out);
+	m_points.assign(out, out + n);
+}
+
 
-	m_points = new_points;
+// puts back points and planes saved from before a slice
+void poly2d::restore(const glm::vec2 points[], size_t npoints, const iline2d planes[], size_t nplanes)
+{
+	m_points.assign(points, points + npoints);
+	m_lines.assign(planes, planes + nplanes);
+	fitaabb();
 }
 
 
 void poly2d::addline(iline2d plane, std::vector<glm::vec2> &out) const
 {
-	plane.clip(m_points, out);
+	out.resize(m_points.size() + 1);
+	out.resize(plane.clip(m_points.data(), m_points.size(), out.data()));
 }
 
 
@@ -6,6 +6,8 @@
 #include <vector>
 #include <glm/glm.hpp>
 
+#include "src/smallvec.hpp"
+
 constexpr glm::vec4 BLACK = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
 constexpr glm::vec4 WHITE = glm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
 constexpr glm::vec4 RED = glm::vec4(1.0f, 0.0f, 0.0f, 1.0f);
@@ -89,20 +91,47 @@ struct iline2d {
 	void flip();
 	void offset(const glm::i32vec2 &pt);
 	void scale(const glm::i32vec2 &origin, const glm::i32vec2 &numer, const glm::i32vec2 &denom);
-	void clip(const std::vector<glm::vec2> &points, std::vector<glm::vec2> &out);
+	// out needs room for npoints + 1, returns how many were written
+	size_t clip(const glm::vec2 points[], size_t npoints, glm::vec2 out[]) const;
 	bool operator==(const iline2d &other) const;
 	// Ax + By + C = 0
 	int32_t a, b, c;
 };
 
+/* batch plane kernels, vectorized where the target has SSE2. the float
+   math matches iline2d::distnumer term for term so both paths agree. */
+// smallest and largest distnumer of npts points against one plane
+void planerange(const iline2d &plane, const glm::vec2 pts[], size_t npts, float &lo, float &hi);
+// true if pt is strictly in front of every plane
+bool infrontofall(const iline2d planes[], size_t nplanes, const glm::vec2 &pt);
+
+/* the axis that last separated a pair of polys. tried first on the next
+   test of the same pair, while dragging it almost always still holds. */
+struct sephint {
+	enum axis : uint8_t {
+		NONE,
+		AABB,   // index is the aabb side
+		OURS,   // index is one of our planes
+		THEIRS  // index is one of the other poly's planes
+	};
+	axis kind = NONE;
+	uint32_t index = 0;
+};
+
 namespace gl { struct texture; }
 namespace act { struct texture; }
 
 struct poly2d {
+	// authored polys rarely get past this many points or planes
+	constexpr static size_t INLINE_CAPACITY = 16;
+	using pointlist = smallvec<glm::vec2, INLINE_CAPACITY>;
+	using planelist = smallvec<iline2d, INLINE_CAPACITY>;
+
 	poly2d(const irect2d &rect);
 	void offset(const glm::i32vec2 &delta);
 	void scale(const glm::i32vec2 &origin, const glm::i32vec2 &numer, const glm::i32vec2 &denom);
 	void slice(iline2d plane);
+	void restore(const glm::vec2 points[], size_t npoints, const iline2d planes[], size_t nplanes);
 	void addline(iline2d plane, std::vector<glm::vec2> &out) const;
 	static bool allptsbehind(const iline2d &plane, const glm::vec2 points[], size_t npoints);
 	static bool allptsbehind(const iline2d &plane, const glm::i32vec2 points[], size_t npoints);
@@ -110,25 +139,31 @@ struct poly2d {
 	void fitaabb();
 	void fitlines();
 	bool intersects(const poly2d &other) const;
+	bool intersects(const poly2d &other, sephint &hint) const;
 	bool intersects(const irect2d &rect) const;
+	bool separates(const poly2d &other, const sephint &hint) const;
+	int sweep(const poly2d &other, const glm::i32vec2 &ofs, int axis, int steps, sephint &hint) const;
+	void scalerange(const poly2d &other, const glm::i32vec2 &origin, int axis, int base, int &lo, int &hi) const;
+	bool scaleclear(const poly2d &other, const glm::i32vec2 &origin, const glm::i32vec2 &base, const glm::i32vec2 &lo, const glm::i32vec2 &hi) const;
 	bool contains(const glm::vec2 &pt) const;
 	gl::texture *texture() const;
 	irect2d uv() const;
 	irect2d uv(const irect2d &aabb) const;
 private:
+	bool sweepclear(const poly2d &other, const glm::vec2 &ofs, const glm::vec2 &d, const sephint &hint) const;
 	// data for collisions
 	irect2d m_aabb;
-	std::vector<iline2d> m_lines;
+	planelist m_lines;
 	// data for rendering
-	std::vector<glm::vec2> m_points;
+	pointlist m_points;
 public:
 	// texture data
 	size_t texindex = -1;
 	int texscale = 1;
 public:
 	inline const irect2d &aabb() const { return m_aabb; }
-	inline const std::vector<glm::vec2> &points() const { return m_points; }
-	inline const std::vector<iline2d> &planes() const { return m_lines; }
+	inline const pointlist &points() const { return m_points; }
+	inline const planelist &planes() const { return m_lines; }
 };
 
 #endif
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <cstddef>
 #include <glad/gl.h>
 
@@ -16,6 +17,13 @@ namespace ia = icon_atlas;
 
 extern void set_window_icon(unsigned char data[], int width, int height);
 
+
+static void bindmatrices(GLuint program)
+{
+	GLuint block = glGetUniformBlockIndex(program, "matrices");
+	glUniformBlockBinding(program, block, gl::ctx::MATRIX_BINDING);
+}
+
 static GLuint compileshaders(const char *fs_src, const char *vs_src)
 {
 	GLuint vs;
@@ -74,61 +82,152 @@ void gl::ctx::clear(const glm::vec4 &color)
 
 void gl::ctx::setmatrices(const glm::mat4 &proj, const glm::mat4 &view)
 {
-	glUseProgram(m_solid_program);
 	glm::mat4 mvp = proj * view;
-	int pos = glGetUniformLocation(m_solid_program, "mvp");
-	glUniformMatrix4fv(pos, 1, GL_FALSE, glm::value_ptr(mvp));
+	float zoom = view[0][0];
+
+	m_matclock++;
+
+	// the world and the ui each keep a slot, a slot is only rewritten
+	// when its view actually changed.
+	size_t slot = 0;
+	for(size_t i = 0; i < MATRIX_SLOTS; i++) {
+		if(m_matuse[i] != 0 && m_matslots[i].mvp == mvp && m_matslots[i].zoom == zoom) {
+			m_matuse[i] = m_matclock;
+			glBindBufferRange(GL_UNIFORM_BUFFER, MATRIX_BINDING, m_matbuf, 
+				i * m_matstride, sizeof(matrices));
+			return;
+		}
 
-	glUseProgram(m_texture_program);
-	pos = glGetUniformLocation(m_texture_program, "mvp");
-	glUniformMatrix4fv(pos, 1, GL_FALSE, glm::value_ptr(mvp));
+		if(m_matuse[i] < m_matuse[slot]) {
+			slot = i;
+		}
+	}
 
-	glUseProgram(m_grid_program);
-	glm::mat4 inv_view = glm::inverse(view);
-	glm::mat4 inv_proj = glm::inverse(proj);
-	glm::mat4 inv_mvp = inv_view * inv_proj;
-	int mvppos = glGetUniformLocation(m_grid_program, "inv_mvp");
-	glUniformMatrix4fv(mvppos, 1, GL_FALSE, glm::value_ptr(inv_mvp));
-	int zoompos = glGetUniformLocation(m_grid_program, "zoom");
-	glUniform1f(zoompos, view[0][0]);
+	matrices &mat = m_matslots[slot];
+	mat.mvp = mvp;
+	mat.inv_mvp = glm::inverse(view) * glm::inverse(proj);
+	mat.zoom = zoom;
+	m_matuse[slot] = m_matclock;
+
+	glBindBuffer(GL_UNIFORM_BUFFER, m_matbuf);
+	glBufferSubData(GL_UNIFORM_BUFFER, slot * m_matstride, sizeof(matrices), &mat);
+	glBindBufferRange(GL_UNIFORM_BUFFER, MATRIX_BINDING, m_matbuf, 
+		slot * m_matstride, sizeof(matrices));
 }
 
 void gl::ctx::drawgrid()
 {
 	// background grid, a single rect
+	beginpass(PASS_GRID);
 	glUseProgram(m_grid_program);
 	glBindVertexArray(m_grid_vao);
 	glDrawArrays(GL_TRIANGLES, 0, 6);
+	endpass();
+	m_frame.draws++;
 
 }
 
 void gl::ctx::end()
 {
-	// draw all texture batches
-	glUseProgram(m_texture_program);
+	beginpass(PASS_TEXTURED);
+	glUseProgram(m_array_program);
+
+	// retained fills first, drawn from their regions in the mesh pools
+	glBindVertexArray(m_meshvao);
+	for(texarray &arr : m_texarrays) {
+		if(arr.meshcounts.empty()) {
+			continue;
+		}
+
+		glBindTexture(GL_TEXTURE_2D_ARRAY, arr.gltex);
+		glMultiDrawElements(GL_TRIANGLES, arr.meshcounts.data(), GL_UNSIGNED_INT, 
+			arr.meshoffsets.data(), arr.meshcounts.size());
+		m_frame.draws++;
+	}
+
+	// level textures, one draw per size
 	glBindVertexArray(m_vao);
+	for(texarray &arr : m_texarrays) {
+		texturebatch &vtc = arr.batch;
+		if(vtc.idx.empty()) {
+			continue;
+		}
+
+		size_t vtxofs = m_vtxbuf.push(vtc.vtx.data(), vtc.vtx.size() * sizeof(vertex), sizeof(vertex));
+		size_t idxofs = m_idxbuf.push(vtc.idx.data(), vtc.idx.size() * sizeof(GLuint), sizeof(GLuint));
+
+		glBindTexture(GL_TEXTURE_2D_ARRAY, arr.gltex);
+		glDrawElementsBaseVertex(GL_TRIANGLES, vtc.idx.size(), GL_UNSIGNED_INT, 
+			(void *)idxofs, vtxofs / sizeof(vertex));
+		m_frame.draws++;
+		m_frame.vertices += vtc.vtx.size();
+	}
+
+	// draw all other texture batches, one draw per texture
+	glUseProgram(m_texture_program);
 	for(auto &[texid, vtc] : m_texture_batches) {
-		glBindBuffer(GL_ARRAY_BUFFER, m_vtxbuf);
-		glBufferData(GL_ARRAY_BUFFER, vtc.vtx.size() * sizeof(vertex), vtc.vtx.data(), GL_STREAM_DRAW);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_idxbuf);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, vtc.idx.size() * sizeof(GLuint), vtc.idx.data(), GL_STREAM_DRAW);
+		if(vtc.idx.empty()) {
+			continue;
+		}
+
+		size_t vtxofs = m_vtxbuf.push(vtc.vtx.data(), vtc.vtx.size() * sizeof(vertex), sizeof(vertex));
+		size_t idxofs = m_idxbuf.push(vtc.idx.data(), vtc.idx.size() * sizeof(GLuint), sizeof(GLuint));
 
 		glBindTexture(GL_TEXTURE_2D, texid);
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_idxbuf);
-		glDrawElements(GL_TRIANGLES, vtc.idx.size(), GL_UNSIGNED_INT, 0);
+		glDrawElementsBaseVertex(GL_TRIANGLES, vtc.idx.size(), GL_UNSIGNED_INT, 
+			(void *)idxofs, vtxofs / sizeof(vertex));
+		m_frame.draws++;
+		m_frame.vertices += vtc.vtx.size();
 	}
 
-	glBindTexture(GL_TEXTURE_2D, m_font_atlas);
+	endpass();
+
+	// draw solid geometry on top, in submission order
+	beginpass(PASS_SOLID);
+	if(!m_solid_idx.empty()) {
+		glUseProgram(m_solid_program);
+		glBindTexture(GL_TEXTURE_2D, m_font_atlas);
+		glBindVertexArray(m_vao);
+
+		size_t vtxofs = m_vtxbuf.push(m_solid_vtx.data(), m_solid_vtx.size() * sizeof(vertex), sizeof(vertex));
+		size_t idxofs = m_idxbuf.push(m_solid_idx.data(), m_solid_idx.size() * sizeof(GLuint), sizeof(GLuint));
+
+		glDrawElementsBaseVertex(GL_TRIANGLES, m_solid_idx.size(), GL_UNSIGNED_INT, 
+			(void *)idxofs, vtxofs / sizeof(vertex));
+		m_frame.draws++;
+		m_frame.vertices += m_solid_vtx.size();
+	}
+
+	// and all lines on top of that, retained ones straight from their
+	// pool, then a single instanced draw for the rest
+	if(!m_meshlinecounts.empty()) {
+		glUseProgram(m_line_program);
+		glBindVertexArray(m_meshlinevao);
+		glMultiDrawArrays(GL_TRIANGLES, m_meshlinefirsts.data(), m_meshlinecounts.data(), 
+			m_meshlinecounts.size());
+		m_frame.draws++;
+	}
+
+	if(!m_lines.empty()) {
+		glUseProgram(m_line_program);
+		glBindVertexArray(m_line_vao);
+
+		size_t ofs = m_vtxbuf.push(m_lines.data(), m_lines.size() * sizeof(segment), sizeof(segment));
 
-	glBindBuffer(GL_ARRAY_BUFFER, m_vtxbuf);
-	glBufferData(GL_ARRAY_BUFFER, m_solid_vtx.size() * sizeof(vertex), m_solid_vtx.data(), GL_STREAM_DRAW);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_idxbuf);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_solid_idx.size() * sizeof(GLuint), m_solid_idx.data(), GL_STREAM_DRAW);
+		// no base instance in 3.3, point the instance attributes at this batch
+		glBindBuffer(GL_ARRAY_BUFFER, m_vtxbuf.glbuf());
+		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(segment), (void *)(ofs + offsetof(segment, a)));
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(segment), (void *)(ofs + offsetof(segment, b)));
+		glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(segment), (void *)(ofs + offsetof(segment, thickness)));
+		glVertexAttribPointer(4, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(segment), (void *)(ofs + offsetof(segment, color)));
 
-	// draw solid geometry
-	glUseProgram(m_solid_program);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_idxbuf);
-	glDrawElements(GL_TRIANGLES, m_solid_idx.size(), GL_UNSIGNED_INT, 0);
+		glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, m_lines.size());
+		m_frame.draws++;
+		m_frame.vertices += m_lines.size() * 4;
+	}
+	endpass();
+
+	begin();
 }
 
 
@@ -136,7 +235,338 @@ void gl::ctx::begin()
 {
 	m_solid_idx.clear();
 	m_solid_vtx.clear();
-	m_texture_batches.clear();
+	m_lines.clear();
+	// keep the per-texture vectors around so their capacity is reused
+	for(auto &[texid, vtc] : m_texture_batches) {
+		vtc.vtx.clear();
+		vtc.idx.clear();
+	}
+
+	for(texarray &arr : m_texarrays) {
+		arr.batch.vtx.clear();
+		arr.batch.idx.clear();
+		arr.meshcounts.clear();
+		arr.meshoffsets.clear();
+	}
+
+	m_meshlinefirsts.clear();
+	m_meshlinecounts.clear();
+}
+
+
+void gl::ctx::beginpass(int pass)
+{
+	if(!m_profiling) {
+		return;
+	}
+
+	std::vector<timerquery> &pool = m_queries[m_queryframe];
+	size_t &used = m_queryused[m_queryframe];
+	if(used == pool.size()) {
+		timerquery &q = pool.emplace_back();
+		glGenQueries(1, &q.id);
+	}
+
+	timerquery &q = pool[used++];
+	q.pass = pass;
+	glBeginQuery(GL_TIME_ELAPSED, q.id);
+}
+
+
+void gl::ctx::endpass()
+{
+	if(!m_profiling) {
+		return;
+	}
+
+	glEndQuery(GL_TIME_ELAPSED);
+}
+
+
+void gl::ctx::beginframe()
+{
+	size_t streamed = m_vtxbuf.pushed() + m_idxbuf.pushed();
+	m_frame.bytes += streamed - m_streamed;
+	m_streamed = streamed;
+
+	float gpu_ms[PASS_COUNT];
+	std::copy(m_stats.gpu_ms, m_stats.gpu_ms + PASS_COUNT, gpu_ms);
+	m_stats = m_frame;
+	m_frame = framestats();
+
+	// the oldest pool was issued QUERY_FRAMES - 1 frames ago, its
+	// results are almost always in so the read rarely stalls.
+	m_queryframe = (m_queryframe + 1) % QUERY_FRAMES;
+
+	std::vector<timerquery> &pool = m_queries[m_queryframe];
+	size_t &used = m_queryused[m_queryframe];
+	if(used != 0) {
+		std::fill(gpu_ms, gpu_ms + PASS_COUNT, 0.0f);
+		for(size_t i = 0; i < used; i++) {
+			GLuint64 ns = 0;
+			glGetQueryObjectui64v(pool[i].id, GL_QUERY_RESULT, &ns);
+			gpu_ms[pool[i].pass] += static_cast<float>(ns) / 1e6f;
+		}
+		used = 0;
+	}
+
+	std::copy(gpu_ms, gpu_ms + PASS_COUNT, m_stats.gpu_ms);
+}
+
+
+static size_t sizeclass(size_t n)
+{
+	size_t i = 0;
+	while((static_cast<size_t>(1) << i) < n) {
+		i++;
+	}
+	return i;
+}
+
+
+void gl::ctx::beginmesh(gl::mesh &mesh)
+{
+	assert(m_mesh == nullptr);
+
+	m_mesh = &mesh;
+	m_meshvtx.clear();
+	m_meshidx.clear();
+	m_meshlines.clear();
+	mesh.array = -1;
+}
+
+
+void gl::ctx::endmesh()
+{
+	assert(m_mesh != nullptr);
+
+	gl::mesh &mesh = *m_mesh;
+	m_mesh = nullptr;
+
+	poolwrite(m_meshvtxpool, mesh.vtxofs, mesh.vtxcap, m_meshvtx.data(), m_meshvtx.size());
+
+	// the fill indices point into the vertex region
+	for(GLuint &i : m_meshidx) {
+		i += mesh.vtxofs;
+	}
+
+	poolwrite(m_meshidxpool, mesh.idxofs, mesh.idxcap, m_meshidx.data(), m_meshidx.size());
+	poolwrite(m_meshlinepool, mesh.lineofs, mesh.linecap, m_meshlines.data(), m_meshlines.size());
+
+	mesh.nidx = m_meshidx.size();
+	mesh.nline = m_meshlines.size();
+	m_frame.vertices += m_meshvtx.size() + m_meshlines.size();
+	mesh.dirty = false;
+}
+
+
+void gl::ctx::freemesh(gl::mesh &mesh)
+{
+	poolfree(m_meshvtxpool, mesh.vtxofs, mesh.vtxcap);
+	poolfree(m_meshidxpool, mesh.idxofs, mesh.idxcap);
+	poolfree(m_meshlinepool, mesh.lineofs, mesh.linecap);
+
+	mesh.nidx = 0;
+	mesh.nline = 0;
+	mesh.dirty = true;
+}
+
+
+// only queues the ranges of the mesh, nothing is copied
+void gl::ctx::drawmesh(const gl::mesh &mesh)
+{
+	assert(!mesh.dirty);
+
+	if(mesh.nline != 0) {
+		m_meshlinefirsts.push_back(mesh.lineofs);
+		m_meshlinecounts.push_back(mesh.nline);
+	}
+
+	if(mesh.nidx != 0) {
+		texarray &arr = m_texarrays[mesh.array];
+		arr.meshcounts.push_back(mesh.nidx);
+		arr.meshoffsets.push_back((const void *)(mesh.idxofs * sizeof(GLuint)));
+	}
+}
+
+
+size_t gl::ctx::poolalloc(pool &p, size_t n)
+{
+	std::vector<size_t> &freelist = p.free[sizeclass(n)];
+	if(!freelist.empty()) {
+		size_t ofs = freelist.back();
+		freelist.pop_back();
+		return ofs;
+	}
+
+	if(p.top + n > p.cap) {
+		poolgrow(p, p.top + n);
+		meshattribs();
+	}
+
+	size_t ofs = p.top;
+	p.top += n;
+	return ofs;
+}
+
+
+void gl::ctx::poolgrow(pool &p, size_t n)
+{
+	size_t cap = std::max<size_t>(p.cap, 1);
+	while(cap < n) {
+		cap *= 2;
+	}
+
+	GLuint buf;
+	glGenBuffers(1, &buf);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buf);
+	glBufferData(GL_COPY_WRITE_BUFFER, cap * p.stride, nullptr, GL_DYNAMIC_DRAW);
+
+	if(p.cap != 0) {
+		// keep every live region where it is
+		glBindBuffer(GL_COPY_READ_BUFFER, p.glbuf);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, p.top * p.stride);
+		glDeleteBuffers(1, &p.glbuf);
+	}
+
+	p.glbuf = buf;
+	p.cap = cap;
+}
+
+
+void gl::ctx::poolfree(pool &p, size_t &ofs, size_t &cap)
+{
+	if(cap != 0) {
+		p.free[sizeclass(cap)].push_back(ofs);
+	}
+
+	ofs = 0;
+	cap = 0;
+}
+
+
+// copies n elements to the region at ofs, moving it when it's too small
+void gl::ctx::poolwrite(pool &p, size_t &ofs, size_t &cap, const void *data, size_t n)
+{
+	if(n > cap) {
+		poolfree(p, ofs, cap);
+		cap = static_cast<size_t>(1) << sizeclass(std::max(n, MESH_MIN_VTX));
+		ofs = poolalloc(p, cap);
+	}
+
+	if(n != 0) {
+		// the copy target leaves the element binding of the bound vao alone
+		glBindBuffer(GL_COPY_WRITE_BUFFER, p.glbuf);
+		glBufferSubData(GL_COPY_WRITE_BUFFER, ofs * p.stride, n * p.stride, data);
+		m_frame.bytes += n * p.stride;
+	}
+}
+
+
+static void vertexattribs()
+{
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(gl::vertex), (void *)offsetof(gl::vertex, pos));
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(gl::vertex), (void *)offsetof(gl::vertex, color));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(gl::vertex), (void *)offsetof(gl::vertex, uv));
+	glEnableVertexAttribArray(2);
+	glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(gl::vertex), (void *)offsetof(gl::vertex, layer));
+	glEnableVertexAttribArray(3);
+}
+
+
+void gl::ctx::addtexture(gl::texture &texture)
+{
+	size_t i = 0;
+	while(i < m_texarrays.size()) {
+		if(m_texarrays[i].width == texture.width() && m_texarrays[i].height == texture.height()) {
+			break;
+		}
+		i++;
+	}
+
+	if(i == m_texarrays.size()) {
+		texarray &arr = m_texarrays.emplace_back();
+		arr.width = texture.width();
+		arr.height = texture.height();
+	}
+
+	texarray &arr = m_texarrays[i];
+
+	texture.m_array = i;
+	texture.m_layer = arr.data.size();
+
+	arr.data.push_back(texture.shared());
+	arr.pixelwidth.push_back(texture.pixelwidth());
+
+	if(arr.data.size() <= arr.cap) {
+		filltexarray(arr, texture.m_layer);
+		return;
+	}
+
+	/* out of layers. storage of an array texture is immutable in size,
+	   so make a bigger one and upload every layer again. */
+	if(arr.gltex != 0) {
+		glDeleteTextures(1, &arr.gltex);
+	}
+
+	arr.cap = std::max(arr.cap * 2, TEXARRAY_INITIAL_LAYERS);
+
+	glGenTextures(1, &arr.gltex);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, arr.gltex);
+
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, arr.width, arr.height, arr.cap, 0, 
+		GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+
+	filltexarray(arr, 0);
+}
+
+
+void gl::ctx::filltexarray(texarray &arr, size_t first)
+{
+	glBindTexture(GL_TEXTURE_2D_ARRAY, arr.gltex);
+	// rgb rows aren't 4 byte aligned
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	for(size_t i = first; i < arr.data.size(); i++) {
+		GLenum format = arr.pixelwidth[i] == 4 ? GL_RGBA : GL_RGB;
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, arr.width, arr.height, 1, 
+			format, GL_UNSIGNED_BYTE, arr.data[i].get());
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+}
+
+
+// points the mesh vaos at the pools, again whenever one of them grew.
+// every pool needs a buffer by then, the attribute pointers of a vao
+// can't be set with no array buffer bound.
+void gl::ctx::meshattribs()
+{
+	glBindVertexArray(m_meshvao);
+	glBindBuffer(GL_ARRAY_BUFFER, m_meshvtxpool.glbuf);
+	vertexattribs();
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_meshidxpool.glbuf);
+
+	glBindVertexArray(m_meshlinevao);
+	glBindBuffer(GL_ARRAY_BUFFER, m_meshlinepool.glbuf);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(linevertex), (void *)offsetof(linevertex, corner));
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(linevertex), (void *)(offsetof(linevertex, seg) + offsetof(segment, a)));
+	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(linevertex), (void *)(offsetof(linevertex, seg) + offsetof(segment, b)));
+	glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, sizeof(linevertex), (void *)(offsetof(linevertex, seg) + offsetof(segment, thickness)));
+	glVertexAttribPointer(4, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(linevertex), (void *)(offsetof(linevertex, seg) + offsetof(segment, color)));
+	for(GLuint i = 0; i <= 4; i++) {
+		glEnableVertexAttribArray(i);
+	}
+
+	glBindVertexArray(0);
 }
 
 
@@ -145,7 +575,7 @@ void gl::ctx::quad(const glm::vec2 q[4], const glm::vec4 &color)
 	gl::vertex vtx;
 	vtx.color = color;
 
-	begin();
+	assert(m_mesh == nullptr);
 
 	for(size_t i = 0; i < 4; i++) {
 		vtx.pos = q[i];
@@ -160,8 +590,6 @@ void gl::ctx::quad(const glm::vec2 q[4], const glm::vec4 &color)
 	m_solid_idx.push_back(i - 2);
 	m_solid_idx.push_back(i - 0);
 	m_solid_idx.push_back(i - 1);
-
-	end();
 }
 
 void gl::ctx::rect(const glm::vec2 &mins, const glm::vec2 &maxs, const glm::vec4 &color)
@@ -179,20 +607,33 @@ void gl::ctx::rect(const glm::vec2 &mins, const glm::vec2 &maxs, const glm::vec4
 
 void gl::ctx::line(const glm::vec2 &a, const glm::vec2 &b, float thickness, const glm::vec4 &color)
 {
-	glm::vec2 delta = glm::normalize(b - a) * thickness * 0.5f;
-	glm::vec2 normal = { -delta.y, delta.x };
+	segment seg;
+	seg.a = a;
+	seg.b = b;
+	seg.thickness = thickness;
+	seg.color = glm::u8vec4(color * 255.0f + 0.5f);
+
+	if(m_mesh != nullptr) {
+		// the two triangles of the instanced strip
+		static const glm::vec2 corners[6] = {
+			{ 0.0f, -1.0f }, { 0.0f, 1.0f }, { 1.0f, -1.0f },
+			{ 0.0f,  1.0f }, { 1.0f, 1.0f }, { 1.0f, -1.0f }
+		};
+		for(const glm::vec2 &corner : corners) {
+			m_meshlines.push_back({ corner, seg });
+		}
+	} else {
+		m_lines.push_back(seg);
+	}
+}
 
-	glm::vec2 q[4] = {
-		(a - delta) - normal,
-		(a - delta) + normal,
-		(b + delta) - normal,
-		(b + delta) + normal
-	};
 
-	quad(q, color);
+void gl::ctx::point(const glm::vec2 &pt, float size, const glm::vec4 &color)
+{
+	line(pt, pt, size, color);
 }
 
-static gl::vertex setvtx(const glm::vec2 &pt, const glm::vec4 &color, const irect2d &aabb)
+static gl::vertex setvtx(const glm::vec2 &pt, const glm::vec4 &color, const irect2d &aabb, int layer)
 {
 	glm::vec2 mins = aabb.mins;
 	glm::vec2 size = aabb.maxs - aabb.mins;
@@ -201,36 +642,48 @@ static gl::vertex setvtx(const glm::vec2 &pt, const glm::vec4 &color, const irec
 	vtx.pos = pt;
 	vtx.color = color;
 	vtx.uv = (pt - mins) / size;
+	vtx.layer = static_cast<float>(layer);
 	return vtx;
 }
 
 
 void gl::ctx::poly(const glm::vec2 pts[], size_t npts, const irect2d &uv, gl::texture &texture, const glm::vec4 &color)
 {
-	begin();
-
-	if(!glIsTexture(texture.gltex())) {
-		texture.init_gltex();
+	if(texture.layer() == -1) {
+		addtexture(texture);
 	}
 
-	vertex start = setvtx(pts[0], color, uv);
-
-	texturebatch &vtc = m_texture_batches[texture.gltex()];
+	int layer = texture.layer();
+	vertex start = setvtx(pts[0], color, uv, layer);
+
+	std::vector<vertex> *vtx;
+	std::vector<GLuint> *idx;
+
+	if(m_mesh != nullptr) {
+		// a mesh only ever holds a single fill
+		assert(m_mesh->array == -1 || m_mesh->array == texture.array());
+		m_mesh->array = texture.array();
+		vtx = &m_meshvtx;
+		idx = &m_meshidx;
+	} else {
+		texturebatch &vtc = m_texarrays[texture.array()].batch;
+		vtx = &vtc.vtx;
+		idx = &vtc.idx;
+	}
 
-	vtc.vtx.push_back(start);
-	size_t start_idx = vtc.vtx.size() - 1;
+	vtx->push_back(start);
+	size_t start_idx = vtx->size() - 1;
 
 	for(size_t i = 1; i < npts; i++) {
 		glm::vec2 a = pts[i];
 		glm::vec2 b = pts[(i + 1) % npts];
-		vtc.vtx.push_back(setvtx(a, color, uv));
-		vtc.vtx.push_back(setvtx(b, color, uv));
+		vtx->push_back(setvtx(a, color, uv, layer));
+		vtx->push_back(setvtx(b, color, uv, layer));
 
-		vtc.idx.push_back(start_idx);
-		vtc.idx.push_back(start_idx + (i * 2) - 1);
-		vtc.idx.push_back(start_idx + (i * 2));
+		idx->push_back(start_idx);
+		idx->push_back(start_idx + (i * 2) - 1);
+		idx->push_back(start_idx + (i * 2));
 	}
-	end();
 }
 
 
@@ -241,18 +694,40 @@ gl::ctx::~ctx()
 	glDeleteVertexArrays(1, &m_grid_vao);
 	glDeleteProgram(m_grid_program);
 
-	glDeleteBuffers(1, &m_vtxbuf);
-	glDeleteBuffers(1, &m_idxbuf);
+	m_vtxbuf.free();
+	m_idxbuf.free();
 	glDeleteVertexArrays(1, &m_vao);
 
+	glDeleteBuffers(1, &m_meshvtxpool.glbuf);
+	glDeleteBuffers(1, &m_meshidxpool.glbuf);
+	glDeleteBuffers(1, &m_meshlinepool.glbuf);
+	glDeleteVertexArrays(1, &m_meshvao);
+	glDeleteVertexArrays(1, &m_meshlinevao);
+
+	glDeleteBuffers(1, &m_matbuf);
+
+	glDeleteBuffers(1, &m_line_cornerbuf);
+	glDeleteVertexArrays(1, &m_line_vao);
+	glDeleteProgram(m_line_program);
+
+	for(texarray &arr : m_texarrays) {
+		glDeleteTextures(1, &arr.gltex);
+	}
+
+	for(std::vector<timerquery> &pool : m_queries) {
+		for(timerquery &q : pool) {
+			glDeleteQueries(1, &q.id);
+		}
+	}
+
 	glDeleteProgram(m_solid_program);
 	glDeleteProgram(m_texture_program);
+	glDeleteProgram(m_array_program);
 }
 
 
 void gl::ctx::icon(const glm::vec2 &pos, ia::position uv, const glm::vec4 &color)
 {
-	begin();
 	texturebatch &vtc = m_texture_batches[m_icon_atlas];
 
 	gl::vertex vtx;
@@ -292,21 +767,20 @@ void gl::ctx::icon(const glm::vec2 &pos, ia::position uv, const glm::vec4 &color
 	vtc.idx.push_back(i - 2);
 	vtc.idx.push_back(i - 0);
 	vtc.idx.push_back(i - 1);
-	end();
 }
 
-void gl::ctx::puts(const glm::vec2 &pos, const glm::vec4 color, const char *ch)
+void gl::ctx::layout(textrun &run, const char *ch) const
 {
-	begin();
+	glm::vec2 dpos = { 0.0f, 0.0f };
 
-	glm::vec2 dpos = pos;
+	run.vtx.clear();
 
 	for(const char *s = ch; *s; s++) {
 
 		tahoma12::position uv = tahoma12::pc[*s];
 
 		gl::vertex vtx;
-		vtx.color = color;
+		vtx.color = glm::vec4(1.0f);
 
 		dpos.x += uv.left;
 		dpos.y -= uv.top;
@@ -315,43 +789,65 @@ void gl::ctx::puts(const glm::vec2 &pos, const glm::vec4 color, const char *ch)
 		vtx.pos = dpos;
 		vtx.uv.x = static_cast<float>(uv.x) / m_font_atlas_width;
 		vtx.uv.y = static_cast<float>(uv.y) / m_font_atlas_height;
-		m_solid_vtx.push_back(vtx);
+		run.vtx.push_back(vtx);
 
 		// top right
 		vtx.pos.x = dpos.x + uv.w;
 		vtx.pos.y = dpos.y;
 		vtx.uv.x = static_cast<float>(uv.x + uv.w) / m_font_atlas_width;
 		vtx.uv.y = static_cast<float>(uv.y) / m_font_atlas_height;
-		m_solid_vtx.push_back(vtx);
+		run.vtx.push_back(vtx);
 
 		// bottom left
 		vtx.pos.x = dpos.x;
 		vtx.pos.y = dpos.y + uv.h;
 		vtx.uv.x = static_cast<float>(uv.x) / m_font_atlas_width;
 		vtx.uv.y = static_cast<float>(uv.y + uv.h) / m_font_atlas_height;
-		m_solid_vtx.push_back(vtx);
+		run.vtx.push_back(vtx);
 
 		// bottom right
 		vtx.pos.x = dpos.x + uv.w;
 		vtx.pos.y = dpos.y + uv.h;
 		vtx.uv.x = static_cast<float>(uv.x + uv.w) / m_font_atlas_width;
 		vtx.uv.y = static_cast<float>(uv.y + uv.h) / m_font_atlas_height;
-		m_solid_vtx.push_back(vtx);
-
-		size_t i = m_solid_vtx.size() - 1;
-		m_solid_idx.push_back(i - 3);
-		m_solid_idx.push_back(i - 2);
-		m_solid_idx.push_back(i - 1);
-		m_solid_idx.push_back(i - 2);
-		m_solid_idx.push_back(i - 0);
-		m_solid_idx.push_back(i - 1);
+		run.vtx.push_back(vtx);
 
 		dpos.x -= uv.left;
 		dpos.y += uv.top;
 		dpos.x += uv.xadvance;
 	}
 
-	end();
+	run.width = dpos.x;
+}
+
+
+void gl::ctx::puts(const glm::vec2 &pos, const glm::vec4 color, const textrun &run)
+{
+	assert(m_mesh == nullptr);
+
+	size_t base = m_solid_vtx.size();
+
+	for(gl::vertex vtx : run.vtx) {
+		vtx.pos += pos;
+		vtx.color = color;
+		m_solid_vtx.push_back(vtx);
+	}
+
+	for(size_t i = base; i < m_solid_vtx.size(); i += 4) {
+		m_solid_idx.push_back(i + 0);
+		m_solid_idx.push_back(i + 1);
+		m_solid_idx.push_back(i + 2);
+		m_solid_idx.push_back(i + 1);
+		m_solid_idx.push_back(i + 3);
+		m_solid_idx.push_back(i + 2);
+	}
+}
+
+
+void gl::ctx::puts(const glm::vec2 &pos, const glm::vec4 color, const char *ch)
+{
+	layout(m_textrun, ch);
+	puts(pos, color, m_textrun);
 }
 
 
@@ -365,13 +861,27 @@ gl::ctx::ctx()
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 	glDisable(GL_MULTISAMPLE);
 
+	// matrices shared by every program, one slot per distinct view
+	GLint align;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &align);
+	m_matstride = (sizeof(matrices) + align - 1) / align * align;
+
+	glGenBuffers(1, &m_matbuf);
+	glBindBuffer(GL_UNIFORM_BUFFER, m_matbuf);
+	glBufferData(GL_UNIFORM_BUFFER, MATRIX_SLOTS * m_matstride, nullptr, GL_DYNAMIC_DRAW);
+
 	// setup grid objects
 	static const char *grid_fs_src = R"(
 		#version 330 core
 		in vec4 s_pos;
 		out vec4 FragColor;
 		uniform float spacing;
-		uniform float zoom;
+
+		layout (std140) uniform matrices {
+			mat4 mvp;
+			mat4 inv_mvp;
+			float zoom;
+		};
 
 		void main()
 		{
@@ -393,7 +903,11 @@ gl::ctx::ctx()
 
 		out vec4 s_pos;
 
-		uniform mat4 inv_mvp;
+		layout (std140) uniform matrices {
+			mat4 mvp;
+			mat4 inv_mvp;
+			float zoom;
+		};
 
 		void main()
 		{
@@ -403,6 +917,7 @@ gl::ctx::ctx()
 	)";
 
 	m_grid_program = compileshaders(grid_fs_src, grid_vs_src);
+	bindmatrices(m_grid_program);
 	/* fullscreen rect. don't bother with EBO. */
 	static float grid_vertices[] = {
 		 1.0f,  1.0f,
@@ -437,7 +952,11 @@ gl::ctx::ctx()
 		out vec4 a_color;
 		out vec2 a_uv;
 
-		uniform mat4 mvp;
+		layout (std140) uniform matrices {
+			mat4 mvp;
+			mat4 inv_mvp;
+			float zoom;
+		};
 
 		void main()
 		{
@@ -467,20 +986,28 @@ gl::ctx::ctx()
 	)";
 
 	m_solid_program = compileshaders(solid_fs_src, solid_vs_src);
+	bindmatrices(m_solid_program);
 
-	glGenBuffers(1, &m_vtxbuf);
-	glGenBuffers(1, &m_idxbuf);
 	glGenVertexArrays(1, &m_vao);
-
 	glBindVertexArray(m_vao);
-	glBindBuffer(GL_ARRAY_BUFFER, m_vtxbuf);
 
-	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(gl::vertex), (void *)offsetof(gl::vertex, pos));
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(gl::vertex), (void *)offsetof(gl::vertex, color));
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(gl::vertex), (void *)offsetof(gl::vertex, uv));
-	glEnableVertexAttribArray(2);
+	// the element binding is vao state, keep the vao bound while
+	// creating the index ring so it sticks.
+	m_vtxbuf.init(GL_ARRAY_BUFFER, STREAM_VTX_SIZE);
+	m_idxbuf.init(GL_ELEMENT_ARRAY_BUFFER, STREAM_IDX_SIZE);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vtxbuf.glbuf());
+	vertexattribs();
+
+	// setup retained mesh objects
+	glGenVertexArrays(1, &m_meshvao);
+	glGenVertexArrays(1, &m_meshlinevao);
+	m_meshvtxpool.stride = sizeof(vertex);
+	m_meshidxpool.stride = sizeof(GLuint);
+	m_meshlinepool.stride = sizeof(linevertex);
+	poolgrow(m_meshvtxpool, MESH_INITIAL_VTX);
+	poolgrow(m_meshidxpool, MESH_INITIAL_IDX);
+	poolgrow(m_meshlinepool, MESH_INITIAL_LINES);
+	meshattribs();
 
 	// setup texture geometry objects
 	static const char *texture_vs_src = R"(
@@ -493,7 +1020,11 @@ gl::ctx::ctx()
 		out vec4 a_color;
 		out vec2 a_uv;
 
-		uniform mat4 mvp;
+		layout (std140) uniform matrices {
+			mat4 mvp;
+			mat4 inv_mvp;
+			float zoom;
+		};
 
 		void main()
 		{
@@ -520,6 +1051,124 @@ gl::ctx::ctx()
 	)";
 
 	m_texture_program = compileshaders(texture_fs_src, texture_vs_src);
+	bindmatrices(m_texture_program);
+
+	// setup level texture objects
+	static const char *array_vs_src = R"(
+		#version 330 core
+
+		layout (location = 0) in vec2 pos;
+		layout (location = 1) in vec4 color;
+		layout (location = 2) in vec2 uv;
+		layout (location = 3) in float layer;
+
+		out vec4 a_color;
+		out vec3 a_uv;
+
+		layout (std140) uniform matrices {
+			mat4 mvp;
+			mat4 inv_mvp;
+			float zoom;
+		};
+
+		void main()
+		{
+			gl_Position = mvp * vec4(pos, 0.0, 1.0);
+			a_color = color;
+			a_uv = vec3(uv, layer);
+		}
+	)";
+
+	static const char *array_fs_src = R"(
+		#version 330 core
+
+		out vec4 FragColor;
+
+		in vec4 a_color;
+		in vec3 a_uv;
+
+		uniform sampler2DArray u_texture;
+
+		void main()
+		{
+			FragColor = a_color * texture(u_texture, a_uv);
+		}
+	)";
+
+	m_array_program = compileshaders(array_fs_src, array_vs_src);
+	bindmatrices(m_array_program);
+
+	// setup instanced line objects
+	static const char *line_vs_src = R"(
+		#version 330 core
+
+		layout (location = 0) in vec2 corner;
+		layout (location = 1) in vec2 a;
+		layout (location = 2) in vec2 b;
+		layout (location = 3) in float thickness;
+		layout (location = 4) in vec4 color;
+
+		out vec4 a_color;
+
+		layout (std140) uniform matrices {
+			mat4 mvp;
+			mat4 inv_mvp;
+			float zoom;
+		};
+
+		void main()
+		{
+			vec2 dir = b - a;
+			float len = length(dir);
+			dir = len > 0.0 ? dir / len : vec2(1.0, 0.0);
+
+			vec2 delta = dir * thickness * 0.5 / zoom;
+			vec2 normal = vec2(-delta.y, delta.x);
+
+			// corner.x picks the end, corner.y the side
+			vec2 pos = mix(a - delta, b + delta, corner.x) + normal * corner.y;
+
+			gl_Position = mvp * vec4(pos, 0.0, 1.0);
+			a_color = color;
+		}
+	)";
+
+	static const char *line_fs_src = R"(
+		#version 330 core
+
+		out vec4 FragColor;
+		in vec4 a_color;
+
+		void main()
+		{
+			FragColor = a_color;
+		}
+	)";
+
+	m_line_program = compileshaders(line_fs_src, line_vs_src);
+	bindmatrices(m_line_program);
+
+	static float line_corners[] = {
+		0.0f, -1.0f,
+		0.0f,  1.0f,
+		1.0f, -1.0f,
+		1.0f,  1.0f
+	};
+
+	glGenBuffers(1, &m_line_cornerbuf);
+	glGenVertexArrays(1, &m_line_vao);
+
+	glBindVertexArray(m_line_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, m_line_cornerbuf);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(line_corners), line_corners, GL_STATIC_DRAW);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void *)0);
+	glEnableVertexAttribArray(0);
+
+	// instance attributes get pointed at the ring in end()
+	for(GLuint i = 1; i <= 4; i++) {
+		glEnableVertexAttribArray(i);
+		glVertexAttribDivisor(i, 1);
+	}
 
 	// icon atlas
 	glGenTextures(1, &m_icon_atlas);
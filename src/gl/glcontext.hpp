@@ -7,6 +7,7 @@
 
 #include "src/geometry.hpp"
 #include "src/gl/texture.hpp"
+#include "src/gl/streambuf.hpp"
 
 #include "res/icon_atlas.png.hpp"
 
@@ -15,6 +16,31 @@ struct vertex {
 	glm::vec2 pos;
 	glm::vec2 uv;
 	glm::vec4 color;
+	float layer = 0.0f;
+};
+
+/* std140 layout of the matrices block every program declares */
+struct matrices {
+	glm::mat4 mvp;
+	glm::mat4 inv_mvp;
+	float zoom;
+	float pad[3];
+};
+
+/* one instance of the line program. the quad is expanded in the
+   vertex shader, thickness is in pixels. points are zero length. */
+struct segment {
+	glm::vec2 a;
+	glm::vec2 b;
+	float thickness;
+	glm::u8vec4 color;
+};
+
+/* a retained segment is expanded to two triangles up front, each
+   vertex carries its corner and the whole segment. */
+struct linevertex {
+	glm::vec2 corner;
+	segment seg;
 };
 
 struct texturebatch {
@@ -22,21 +48,129 @@ struct texturebatch {
 	std::vector<GLuint> idx;
 };
 
+/* level textures of the same size share one array texture, the layer
+   goes into the vertex. a level is filled with one draw per size. */
+struct texarray {
+	GLuint gltex = 0;
+	size_t width = 0;
+	size_t height = 0;
+	size_t cap = 0;
+	// pixels of every layer, needed to refill the array when it grows.
+	// held so they outlive the texture or mapping they came from.
+	std::vector<gl::texture::pixels> data;
+	std::vector<size_t> pixelwidth;
+	texturebatch batch;
+	// index ranges of the retained fills drawn this frame
+	std::vector<GLsizei> meshcounts;
+	std::vector<const void *> meshoffsets;
+};
+
+/* gpu buffer carved into power of two sized regions, recycled through
+   one free list per size. sizes and offsets count elements of stride
+   bytes. growing keeps every live region where it is. */
+struct pool {
+	GLuint glbuf = 0;
+	size_t stride = 0;
+	size_t cap = 0;
+	size_t top = 0;
+	std::vector<size_t> free[32];
+};
+
+/* geometry that is recorded once and kept on the gpu until it is
+   marked dirty. fill vertices, fill indices and expanded line segments
+   each live in a region of their pool, drawing a clean mesh only
+   queues its ranges. */
+struct mesh {
+	size_t vtxofs = 0;
+	size_t vtxcap = 0;
+	size_t idxofs = 0;
+	size_t idxcap = 0;
+	size_t nidx = 0;
+	size_t lineofs = 0;
+	size_t linecap = 0;
+	size_t nline = 0;
+	int array = -1;
+	bool dirty = true;
+};
+
+/* glyph quads of a laid out string, positioned relative to the pen
+   origin. laying out text once and appending the run each frame skips
+   the per-glyph atlas lookups. */
+struct textrun {
+	std::vector<gl::vertex> vtx;
+	float width = 0.0f;
+};
+
+enum pass : int {
+	PASS_GRID,
+	PASS_TEXTURED,
+	PASS_SOLID,
+	PASS_COUNT
+};
+
+/* what one frame cost, gathered between beginframe() calls */
+struct framestats {
+	uint32_t draws = 0;
+	uint32_t vertices = 0;
+	size_t bytes = 0;
+	// gpu time of each pass, a few frames behind
+	float gpu_ms[PASS_COUNT] = {};
+};
+
 struct ctx {
+	constexpr static size_t MATRIX_SLOTS = 4;
+	constexpr static size_t QUERY_FRAMES = 3;
+	constexpr static GLuint MATRIX_BINDING = 0;
+
 	ctx();
 	~ctx();
 	void clear(const glm::vec4 &color);
 	void setmatrices(const glm::mat4 &proj, const glm::mat4 &view);
 	void drawgrid();
+	// primitives are batched between begin() and end(). end() draws every
+	// textured batch first, then solid geometry and lines on top of it, so
+	// callers must flush() before anything that has to be drawn over those.
 	void begin();
 	void end();
+	void flush() { end(); }
 	void quad(const glm::vec2 q[4], const glm::vec4 &color);
 	void rect(const glm::vec2 &mins, const glm::vec2 &maxs, const glm::vec4 &color);
 	void line(const glm::vec2 &a, const glm::vec2 &b, float thickness, const glm::vec4 &color);
+	void point(const glm::vec2 &pt, float size, const glm::vec4 &color);
 	void poly(const glm::vec2 pts[], size_t npts, const irect2d &uv, gl::texture &texture, const glm::vec4 &color);
 	void icon(const glm::vec2 &pos, icon_atlas::position uv, const glm::vec4 &color);
 	void puts(const glm::vec2 &pos, const glm::vec4 color, const char *s);
+	void puts(const glm::vec2 &pos, const glm::vec4 color, const textrun &run);
+	void layout(textrun &run, const char *s) const;
+	// line and poly calls in between record into the mesh instead of the
+	// current batch.
+	void beginmesh(gl::mesh &mesh);
+	void endmesh();
+	void freemesh(gl::mesh &mesh);
+	void drawmesh(const gl::mesh &mesh);
+	// closes the counters of the last frame. timer queries are only
+	// issued while profiling and read back QUERY_FRAMES frames later.
+	void beginframe();
+	void profile(bool on) { m_profiling = on; }
+	bool profiling() const { return m_profiling; }
+	const framestats &stats() const { return m_stats; }
 private:
+	void beginpass(int pass);
+	void endpass();
+	size_t poolalloc(pool &p, size_t n);
+	void poolgrow(pool &p, size_t n);
+	void poolfree(pool &p, size_t &ofs, size_t &cap);
+	void poolwrite(pool &p, size_t &ofs, size_t &cap, const void *data, size_t n);
+	void meshattribs();
+	void addtexture(gl::texture &texture);
+	void filltexarray(texarray &arr, size_t first);
+
+	GLuint m_matbuf;
+	size_t m_matstride;
+	matrices m_matslots[MATRIX_SLOTS];
+	uint64_t m_matuse[MATRIX_SLOTS] = {};
+	uint64_t m_matclock = 0;
+
 	// gl objects for backgroud grid
 	GLuint m_grid_program;
 	GLuint m_grid_vtxbuf;
@@ -47,11 +181,18 @@ private:
 	std::vector<vertex> m_solid_vtx;
 	std::vector<GLuint> m_solid_idx;
 
+	// gl objects for instanced lines
+	GLuint m_line_program;
+	GLuint m_line_cornerbuf;
+	GLuint m_line_vao;
+	std::vector<segment> m_lines;
+
 	GLuint m_icon_atlas;
 	int m_icon_atlas_width;
 	int m_icon_atlas_height;
 
 	GLuint m_font_atlas;
+	textrun m_textrun;
 	int m_font_atlas_width;
 	int m_font_atlas_height;
 
@@ -59,10 +200,49 @@ private:
 	GLuint m_texture_program;
 	std::unordered_map<GLuint, texturebatch> m_texture_batches;
 
-	GLuint m_vtxbuf;
-	GLuint m_idxbuf;
+	// gl objects for rendering level textures
+	GLuint m_array_program;
+	std::vector<texarray> m_texarrays;
+
+	gl::streambuf m_vtxbuf;
+	gl::streambuf m_idxbuf;
 	GLuint m_vao;
+
+	// retained meshes, recorded into the scratch vectors and copied to
+	// their regions in endmesh()
+	pool m_meshvtxpool;
+	pool m_meshidxpool;
+	pool m_meshlinepool;
+	GLuint m_meshvao;
+	GLuint m_meshlinevao;
+	gl::mesh *m_mesh = nullptr;
+	std::vector<vertex> m_meshvtx;
+	std::vector<GLuint> m_meshidx;
+	std::vector<linevertex> m_meshlines;
+	// line ranges of the retained meshes drawn this frame
+	std::vector<GLint> m_meshlinefirsts;
+	std::vector<GLsizei> m_meshlinecounts;
+
+	// GL_TIME_ELAPSED queries, one pool per frame in flight
+	struct timerquery {
+		GLuint id;
+		int pass;
+	};
+	std::vector<timerquery> m_queries[QUERY_FRAMES];
+	size_t m_queryused[QUERY_FRAMES] = {};
+	size_t m_queryframe = 0;
+	bool m_profiling = false;
+	framestats m_frame;
+	framestats m_stats;
+	size_t m_streamed = 0;
 public:
+	constexpr static size_t STREAM_VTX_SIZE = 4 << 20;
+	constexpr static size_t STREAM_IDX_SIZE = 1 << 20;
+	constexpr static size_t MESH_MIN_VTX = 16;
+	constexpr static size_t MESH_INITIAL_VTX = 1 << 16;
+	constexpr static size_t MESH_INITIAL_IDX = 1 << 16;
+	constexpr static size_t MESH_INITIAL_LINES = 1 << 16;
+	constexpr static size_t TEXARRAY_INITIAL_LAYERS = 4;
 	constexpr static int GRID_SPACING = 1;
 	[[nodiscard]] static glm::i32vec2 snaptogrid(const glm::vec2 &pt)
 	{
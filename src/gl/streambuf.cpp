@@ -0,0 +1,57 @@
+#include <cstring>
+
+#include "src/gl/streambuf.hpp"
+
+
+void gl::streambuf::init(GLenum target, size_t size)
+{
+	m_target = target;
+	m_size = size;
+	m_head = 0;
+
+	glGenBuffers(1, &m_glbuf);
+	glBindBuffer(m_target, m_glbuf);
+	glBufferData(m_target, m_size, nullptr, GL_STREAM_DRAW);
+}
+
+
+void gl::streambuf::free()
+{
+	glDeleteBuffers(1, &m_glbuf);
+	m_glbuf = 0;
+}
+
+
+size_t gl::streambuf::push(const void *data, size_t size, size_t align)
+{
+	size_t ofs = (m_head + align - 1) / align * align;
+
+	glBindBuffer(m_target, m_glbuf);
+
+	if(ofs + size > m_size) {
+		while(m_size < size) {
+			m_size *= 2;
+		}
+		/* orphan the old storage, draws still reading from it
+		   keep it alive on the driver side. */
+		glBufferData(m_target, m_size, nullptr, GL_STREAM_DRAW);
+		ofs = 0;
+	}
+
+	GLbitfield access = GL_MAP_WRITE_BIT 
+	                  | GL_MAP_INVALIDATE_RANGE_BIT 
+	                  | GL_MAP_UNSYNCHRONIZED_BIT;
+
+	void *dst = glMapBufferRange(m_target, ofs, size, access);
+	if(dst != nullptr) {
+		memcpy(dst, data, size);
+		glUnmapBuffer(m_target);
+	} else {
+		glBufferSubData(m_target, ofs, size, data);
+	}
+
+	m_head = ofs + size;
+	m_pushed += size;
+
+	return ofs;
+}
@@ -0,0 +1,30 @@
+#ifndef _STREAMBUF_HPP
+#define _STREAMBUF_HPP
+
+#include <cstddef>
+#include <glad/gl.h>
+
+namespace gl {
+/* ring of gpu memory for data that is rewritten every frame. each push
+   gets its own sub-allocation which is written through an unsynchronized
+   map, so earlier draws sourcing the ring are never waited on. once the
+   ring is full the storage is orphaned and writing starts over at 0. */
+struct streambuf {
+	void init(GLenum target, size_t size);
+	void free();
+	// returns the byte offset of the copy within the buffer
+	size_t push(const void *data, size_t size, size_t align);
+private:
+	GLuint m_glbuf = 0;
+	GLenum m_target = 0;
+	size_t m_size = 0;
+	size_t m_head = 0;
+	size_t m_pushed = 0;
+public:
+	GLuint glbuf() const { return m_glbuf; }
+	// bytes pushed since init
+	size_t pushed() const { return m_pushed; }
+};
+}
+
+#endif
@@ -8,7 +8,7 @@
 #include "src/gl/texture.hpp"
 
 
-static uint32_t fnv1a(unsigned char *data, size_t size)
+static uint32_t fnv1a(const unsigned char *data, size_t size)
 {
 	static constexpr uint32_t OFFSET_BASIS = 0x811C9DC5;
 	static constexpr uint32_t PRIME = 0x01000193;
@@ -48,17 +48,18 @@ void gl::texture::serialize(l2d::texinfo &info, std::vector<unsigned char> &data
 	info.data_ofs = data.size();
 	size_t nbytes = m_width * m_height * m_pixelwidth;
 	data.resize(data.size() + nbytes);
-	memcpy(data.data() + info.data_ofs, m_data, nbytes);
+	memcpy(data.data() + info.data_ofs, m_data.get(), nbytes);
 
 }
 
-void gl::texture::load(size_t width, size_t height, size_t pixelwidth, const char *name, unsigned char *data)
+void gl::texture::load(size_t width, size_t height, size_t pixelwidth, const char *name, pixels data)
 {
+	m_data = std::move(data);
 	m_name = name;
 	m_width = width;
 	m_height = height;
 	m_pixelwidth = pixelwidth;
-	m_hash = fnv1a(m_data, width * height * pixelwidth);
+	m_hashed = false;
 }
 
 
@@ -76,12 +77,12 @@ bool gl::texture::load(const char *path)
 
 	unsigned char *new_data = new unsigned char[width * height * nchan];
 
-	m_data = stbir_resize_uint8_linear(data, w, h, w * nchan, 
-		new_data, width, height, m_width * nchan, (stbir_pixel_layout)nchan);
+	unsigned char *resized = stbir_resize_uint8_linear(data, w, h, w * nchan, 
+		new_data, width, height, width * nchan, (stbir_pixel_layout)nchan);
 
-	assert(m_data == new_data);
+	assert(resized == new_data);
 
-	load(width, height, nchan, path, m_data);
+	load(width, height, nchan, path, pixels(new_data));
 
 	stbi_image_free(data);
 
@@ -89,32 +90,21 @@ bool gl::texture::load(const char *path)
 }
 
 
-void gl::texture::init_gltex()
+uint32_t gl::texture::hash() const
 {
-	glGenTextures(1, &m_gltex);
-	glBindTexture(GL_TEXTURE_2D, m_gltex);
-
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-
-	if(m_pixelwidth == 4) {
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, m_width, m_height, 0,
-			GL_RGBA, GL_UNSIGNED_BYTE, m_data);
-	} else {
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, m_width, m_height, 0,
-			GL_RGB, GL_UNSIGNED_BYTE, m_data);
+	if(!m_hashed) {
+		m_hash = fnv1a(m_data.get(), m_width * m_height * m_pixelwidth);
+		m_hashed = true;
 	}
 
-	glBindTexture(GL_TEXTURE_2D, 0);
+	return m_hash;
 }
 
 
 bool gl::texture::operator==(const texture &other)
 {
 	// broad phase
-	if(m_hash != other.m_hash) {
+	if(hash() != other.hash()) {
 		return false;
 	}
 
@@ -125,17 +115,11 @@ bool gl::texture::operator==(const texture &other)
 	}
 
 	// narrow phase
-	return memcmp(m_data, other.m_data, nbytes) == 0;
+	return memcmp(m_data.get(), other.m_data.get(), nbytes) == 0;
 }
 
 
 void gl::texture::free()
 {
-	if(glIsTexture(m_gltex)) {
-		glDeleteTextures(1, &m_gltex);
-	}
-
-	if(m_data != nullptr) {
-		delete[] m_data;
-	}
+	m_data.reset();
 }
@@ -2,6 +2,7 @@
 #define _TEXTURE_HPP
 
 #include <string>
+#include <memory>
 #include <glad/gl.h>
 #include "src/edit/l2dfile.hpp"
 
@@ -9,23 +10,35 @@ namespace gl {
 struct texture {
 	static constexpr int THUMB_SIZE_X = 32;
 	static constexpr int THUMB_SIZE_Y = 32;
-	void load(size_t width, size_t height, size_t pixelwidth, const char *name, unsigned char *data);
+	using pixels = std::shared_ptr<const unsigned char[]>;
+	void load(size_t width, size_t height, size_t pixelwidth, const char *name, pixels data);
 	bool load(const char *path);
 	void free();
-	void init_gltex();
 	void serialize(l2d::texinfo &info, std::vector<unsigned char> &data, std::vector<unsigned char> &strings) const;
 	bool operator==(const texture &other);
 private:
-	GLuint m_gltex = 0;
-	unsigned char *m_data = nullptr;
+	friend struct ctx;
+	// array and layer this texture was uploaded to by gl::ctx
+	int m_array = -1;
+	int m_layer = -1;
+	// shared with the copies of this texture and pending saves, never
+	// written after load
+	pixels m_data;
 	size_t m_pixelwidth = 0;
 	size_t m_width = 0;
 	size_t m_height = 0;
 	std::string m_name;
 	size_t m_thumb = 0;
-	uint32_t m_hash = 0;
+	// hashed on the first compare, a mapped texture isn't paged in before
+	mutable uint32_t m_hash = 0;
+	mutable bool m_hashed = false;
+	uint32_t hash() const;
 public:
-	GLuint gltex() const { return m_gltex; }
+	int array() const { return m_array; }
+	int layer() const { return m_layer; }
+	const unsigned char *data() const { return m_data.get(); }
+	const pixels &shared() const { return m_data; }
+	size_t pixelwidth() const { return m_pixelwidth; }
 	const std::string &name() const { return m_name; }
 	size_t thumb() const { return m_thumb; }
 	size_t width() const { return m_width; }
@@ -31,6 +31,16 @@ static void framebuffer_size_callback(GLFWwindow *window, int width, int height)
 	}
 }
 
+static void window_refresh_callback(GLFWwindow *window)
+{
+	(void)window;
+
+	if(m_selectededitor != -1) {
+		l2d::editor &ed = s_notebook[m_selectededitor];
+		ed.invalidate(l2d::editor::REDRAW_ALL);
+	}
+}
+
 static void cursor_position_callback(GLFWwindow *window, double x, double y)
 {
 	if(m_selectededitor != -1) {
@@ -140,6 +150,7 @@ int main(int argc, char **argv)
 	framebuffer_size_callback(s_window, s_width, s_height);
 
 	glfwSetFramebufferSizeCallback(s_window, &framebuffer_size_callback);
+	glfwSetWindowRefreshCallback(s_window, &window_refresh_callback);
 	glfwSetCursorPosCallback(s_window, &cursor_position_callback);
 	glfwSetScrollCallback(s_window, &scroll_callback);
 	glfwSetMouseButtonCallback(s_window, &mouse_button_callback);
@@ -151,14 +162,34 @@ int main(int argc, char **argv)
 	s_notebook.emplace_back(s_width, s_height);
 
 	while(!glfwWindowShouldClose(s_window)) {
-		glfwWaitEvents();
+		// wake up in time to write out a pending journal batch
+		bool pending = m_selectededitor != -1 && s_notebook[m_selectededitor].autosavepending();
+		if(pending) {
+			glfwWaitEventsTimeout(l2d::journal::FLUSH_MS / 1000.0);
+		} else {
+			glfwWaitEvents();
+		}
+
 		if(m_selectededitor != -1) {
 			l2d::editor &ed = s_notebook[m_selectededitor];
-			ed.paint();
-			glfwSwapBuffers(s_window);
+			// nothing visible changed, keep showing the last frame
+			if(ed.needspaint()) {
+				ed.paint();
+				glfwSwapBuffers(s_window);
+			}
+			ed.autosave();
 		}
 	}
 
+	// fold the journals back into their files
+	for(l2d::editor &ed : s_notebook) {
+		ed.save();
+	}
+
+	for(l2d::editor &ed : s_notebook) {
+		ed.finishsave(true);
+	}
+
 	if(s_window != nullptr) {
 		glfwDestroyWindow(s_window);
 	}
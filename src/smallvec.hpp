@@ -0,0 +1,82 @@
+#ifndef _SMALLVEC_HPP
+#define _SMALLVEC_HPP
+
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+
+/* vector of trivially copyable elements that keeps the first N inline
+   and only moves to the heap once it grows past that. */
+template<typename T, size_t N>
+struct smallvec {
+	T *data() { return m_heap.empty() ? m_inline : m_heap.data(); }
+	const T *data() const { return m_heap.empty() ? m_inline : m_heap.data(); }
+	size_t size() const { return m_size; }
+	bool empty() const { return m_size == 0; }
+
+	T *begin() { return data(); }
+	T *end() { return data() + m_size; }
+	const T *begin() const { return data(); }
+	const T *end() const { return data() + m_size; }
+
+	T &operator[](size_t i) { return data()[i]; }
+	const T &operator[](size_t i) const { return data()[i]; }
+
+	void push_back(const T &v)
+	{
+		if(m_heap.empty()) {
+			if(m_size < N) {
+				m_inline[m_size++] = v;
+				return;
+			}
+			// spill
+			m_heap.reserve(N * 2);
+			m_heap.assign(m_inline, m_inline + m_size);
+		}
+
+		m_heap.push_back(v);
+		m_size++;
+	}
+
+	// first..last must not point into this vector
+	void assign(const T *first, const T *last)
+	{
+		size_t n = last - first;
+		if(n <= N) {
+			m_heap.clear();
+			std::copy(first, last, m_inline);
+		} else {
+			m_heap.assign(first, last);
+		}
+		m_size = n;
+	}
+
+	T *erase(T *first, T *last)
+	{
+		size_t ofs = first - begin();
+		T *e = std::copy(last, end(), first);
+		m_size = e - begin();
+		if(!m_heap.empty()) {
+			// fall back to the inline storage once it fits again
+			if(m_size <= N) {
+				std::copy(m_heap.begin(), m_heap.begin() + m_size, m_inline);
+				m_heap.clear();
+			} else {
+				m_heap.resize(m_size);
+			}
+		}
+		return begin() + ofs;
+	}
+
+	void clear()
+	{
+		m_heap.clear();
+		m_size = 0;
+	}
+private:
+	T m_inline[N];
+	std::vector<T> m_heap;
+	size_t m_size = 0;
+};
+
+#endif
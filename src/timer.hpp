@@ -0,0 +1,24 @@
+#ifndef _TIMER_HPP
+#define _TIMER_HPP
+
+#include <chrono>
+
+/* adds the milliseconds spent in its scope to a counter */
+struct scopedtimer {
+	using clock = std::chrono::steady_clock;
+
+	scopedtimer(float &ms)
+		: m_ms(ms), m_start(clock::now()) {}
+	~scopedtimer()
+	{
+		std::chrono::duration<float, std::milli> d = clock::now() - m_start;
+		m_ms += d.count();
+	}
+	scopedtimer(const scopedtimer &) = delete;
+	scopedtimer &operator=(const scopedtimer &) = delete;
+private:
+	float &m_ms;
+	clock::time_point m_start;
+};
+
+#endif